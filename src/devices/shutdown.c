@@ -5,9 +5,12 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/memstats.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/process.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
@@ -87,15 +90,27 @@ shutdown_reboot (void)
 void
 shutdown_power_off (void)
 {
-  const char s[] = "Shutdown";
-  const char *p;
-
 #ifdef FILESYS
+#ifdef USERPROG
+  process_done ();
+#endif
   filesys_done ();
 #endif
 
   print_stats ();
 
+  shutdown_power_off_now ();
+}
+
+/* Powers down the machine at once, without writing back file
+   system state or printing statistics.  Used to simulate a
+   crash. */
+void
+shutdown_power_off_now (void)
+{
+  const char s[] = "Shutdown";
+  const char *p;
+
   printf ("Powering off...\n");
   serial_flush ();
 
@@ -130,6 +145,8 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  kmem_print_stats ();
+  memstats_print ();
 #ifdef FILESYS
   block_print_stats ();
 #endif
@@ -5,12 +5,26 @@
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
+#include "devices/timer.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
+/* Ticks between journal commits. */
+#define FLUSH_TICKS TIMER_FREQ
+
+/* Flusher thread, which commits the journal in the
+   background. */
+static struct semaphore flush_sema;     /* Upped to wake the flusher. */
+static bool flusher_started;            /* Has it been created? */
+static int flush_ticks;                 /* Ticks since last wake-up. */
+
 static void do_format (void);
+static thread_func flusher;
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -22,12 +36,26 @@ filesys_init (bool format)
     PANIC ("No file system device found, can't initialize file system.");
 
   inode_init ();
+  file_init ();
+  dir_init ();
   free_map_init ();
+  journal_init (format);
 
   if (format) 
     do_format ();
 
   free_map_open ();
+
+  /* A crash test needs to know which transaction the crash
+     interrupts, so it gets no background commits. */
+  if (journal_crash == JOURNAL_CRASH_NONE)
+    {
+      sema_init (&flush_sema, 0);
+      if (thread_create ("fs-flusher", PRI_DEFAULT, flusher, NULL)
+          == TID_ERROR)
+        PANIC ("can't create file system flusher");
+      flusher_started = true;
+    }
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -36,8 +64,23 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  journal_done ();
 }
 
+/* Called by the timer interrupt handler at each timer tick.
+   Periodically wakes the flusher thread if there is metadata
+   to commit. */
+void
+filesys_tick (void) 
+{
+  if (flusher_started && ++flush_ticks >= FLUSH_TICKS)
+    {
+      flush_ticks = 0;
+      if (free_map_dirty () || journal_dirty ())
+        sema_up (&flush_sema);
+    }
+}
+
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
@@ -46,14 +89,19 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = dir_open_root ();
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector)
+             && inode_create (inode_sector, initial_size)
+             && dir_add (dir, name, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
+  journal_end ();
 
   return success;
 }
@@ -83,9 +131,14 @@ filesys_open (const char *name)
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = dir_open_root ();
+  success = dir != NULL && dir_remove (dir, name);
   dir_close (dir); 
+  journal_end ();
 
   return success;
 }
@@ -99,5 +152,18 @@ do_format (void)
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
+  journal_commit ();
   printf ("done.\n");
 }
+
+/* Flusher thread.  Commits the journal each time filesys_tick()
+   wakes it. */
+static void
+flusher (void *aux UNUSED) 
+{
+  for (;;)
+    {
+      sema_down (&flush_sema);
+      journal_commit ();
+    }
+}
@@ -1,12 +1,40 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include <stdio.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
+
+/* The free map is kept in memory and written back to its file
+   lazily.  Each change marks the sectors of the free map file
+   that hold the changed bits as dirty, and free_map_sync()
+   writes just those sectors into the journal.  Each journal
+   commit calls free_map_sync(), as does free_map_close().
+
+   A sector that is freed stays pending until the journal commits
+   the transaction that freed it, and cannot be allocated in the
+   meantime.  Otherwise new file data, which is written in place,
+   could overwrite a sector that a crash would give back to its
+   old file.  The free map file records pending sectors as free,
+   since that is how the transaction leaves them. */
+
+/* Number of free map bits in one sector of the free map file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct bitmap *dirty_map;     /* Free map file sectors to write. */
+static size_t dirty_cnt;             /* Number of bits set in dirty_map. */
+static struct bitmap *pending_map;   /* Freed sectors not yet committed. */
+static size_t pending_cnt;           /* Number of bits set in pending_map. */
+static size_t free_cnt;              /* Free sectors, excluding pending. */
+static struct lock free_map_lock;    /* Protects all of the above. */
+
+static void mark_dirty (size_t start, size_t cnt);
 
 /* Initializes the free map. */
 void
@@ -15,38 +43,124 @@ free_map_init (void)
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  dirty_map = bitmap_create (DIV_ROUND_UP (bitmap_size (free_map),
+                                           BITS_PER_SECTOR));
+  if (dirty_map == NULL)
+    PANIC ("dirty map creation failed");
+  pending_map = bitmap_create (bitmap_size (free_map));
+  if (pending_map == NULL)
+    PANIC ("pending map creation failed");
+  lock_init (&free_map_lock);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+  free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available.  Sectors whose release has not been
+   committed are not available. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = bitmap_scan (free_map, 0, cnt, false);
+  while (sector != BITMAP_ERROR
+         && bitmap_contains (pending_map, sector, cnt, true))
+    sector = bitmap_scan (free_map, sector + 1, cnt, false);
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      free_cnt -= cnt;
+      mark_dirty (sector, cnt);
     }
+  lock_release (&free_map_lock);
+
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Frees CNT sectors starting at SECTOR.  They become available
+   for use once the current transaction commits. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  bitmap_set_multiple (pending_map, sector, cnt, true);
+  pending_cnt += cnt;
+  mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Makes the sectors freed since the last call available for
+   use.  Called by the journal once the transaction that freed
+   them has been committed and written to its home locations. */
+void
+free_map_commit (void) 
+{
+  lock_acquire (&free_map_lock);
+  if (pending_cnt > 0)
+    {
+      bitmap_set_all (pending_map, false);
+      free_cnt += pending_cnt;
+      pending_cnt = 0;
+    }
+  lock_release (&free_map_lock);
+}
+
+/* Returns true if more freed sectors are waiting for a commit
+   than are available for use now.  Safe to call without
+   free_map_lock, but the answer may be stale by the time it is
+   used. */
+bool
+free_map_short (void) 
+{
+  return pending_cnt > free_cnt;
+}
+
+/* Writes the sectors of the free map file that hold bits changed
+   since they were last written.  Returns true if successful,
+   false if a write failed, in which case the sectors that were
+   not written stay dirty. */
+bool
+free_map_sync (void) 
+{
+  bool success = true;
+  size_t i;
+
+  lock_acquire (&free_map_lock);
+  if (free_map_file != NULL)
+    for (i = 0; dirty_cnt > 0 && i < bitmap_size (dirty_map); i++)
+      if (bitmap_test (dirty_map, i))
+        {
+          if (bitmap_write_range (free_map, free_map_file,
+                                  i * BITS_PER_SECTOR, BITS_PER_SECTOR))
+            {
+              bitmap_reset (dirty_map, i);
+              dirty_cnt--;
+            }
+          else
+            success = false;
+        }
+  lock_release (&free_map_lock);
+
+  return success;
+}
+
+/* Returns true if the free map has changes that have not been
+   written to disk.  Safe to call from an interrupt handler, but
+   the answer may be stale by the time it is used. */
+bool
+free_map_dirty (void) 
+{
+  return dirty_cnt > 0;
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -56,15 +170,24 @@ free_map_open (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
+  inode_set_journaled (file_get_inode (free_map_file));
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  free_cnt = (bitmap_count (free_map, 0, bitmap_size (free_map), false)
+              - pending_cnt);
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+  if (!free_map_sync ())
+    printf ("free map: write failed\n");
+
+  lock_acquire (&free_map_lock);
   file_close (free_map_file);
+  free_map_file = NULL;
+  lock_release (&free_map_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -76,10 +199,41 @@ free_map_create (void)
   if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
+  /* Write bitmap to file.  This allocates the file's sectors,
+     which takes free_map_lock, so we can't hold it here.  The
+     allocations mark the bits they change dirty again, so
+     free_map_close() writes them too.  Once written, the file
+     has no holes, so free_map_sync() can write it with
+     free_map_lock held. */
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
+  inode_set_journaled (file_get_inode (free_map_file));
+  lock_acquire (&free_map_lock);
+  bitmap_set_all (dirty_map, false);
+  dirty_cnt = 0;
+  lock_release (&free_map_lock);
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
+
+/* Marks the free map file sectors that hold the CNT bits
+   starting at START as needing to be written.
+   free_map_lock must be held. */
+static void
+mark_dirty (size_t start, size_t cnt) 
+{
+  size_t first = start / BITS_PER_SECTOR;
+  size_t last = (start + cnt - 1) / BITS_PER_SECTOR;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+  ASSERT (cnt > 0);
+
+  for (i = first; i <= last; i++)
+    if (!bitmap_test (dirty_map, i))
+      {
+        bitmap_mark (dirty_map, i);
+        dirty_cnt++;
+      }
+}
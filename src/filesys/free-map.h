@@ -10,6 +10,10 @@ void free_map_read (void);
 void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
+bool free_map_sync (void);
+bool free_map_dirty (void);
+void free_map_commit (void);
+bool free_map_short (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
 void free_map_release (block_sector_t, size_t);
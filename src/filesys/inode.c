@@ -1,74 +1,173 @@
 #include "filesys/inode.h"
 #include <list.h>
 #include <debug.h>
+#include <iovec.h>
 #include <round.h>
+#include <stdio.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of sector numbers in the inode itself and in an
+   indirect block. */
+#define DIRECT_CNT 123
+#define INDIRECT_CNT (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Maximum number of data sectors in a file. */
+#define MAX_SECTORS (DIRECT_CNT + INDIRECT_CNT + INDIRECT_CNT * INDIRECT_CNT)
+
+/* Maximum bytes of data stored in the inode itself. */
+#define INLINE_MAX ((DIRECT_CNT + 2) * sizeof (block_sector_t))
+
+/* Inode flags. */
+#define INODE_INLINE 0x1        /* Data is in inline_data[]. */
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   The inode maps a file's data sectors through DIRECT_CNT direct
+   sector numbers, an indirect block of INDIRECT_CNT more, and a
+   doubly indirect block of INDIRECT_CNT indirect blocks.  A
+   sector number of 0 (which is always the free map's inode, so
+   never file data) marks a hole: a range of the file that has
+   never been written, which reads as zeros and takes no space on
+   disk.  Data sectors and indirect blocks are allocated on the
+   first write that touches them.
+
+   A file of at most INLINE_MAX bytes instead keeps its data in
+   the inode, in the space used by the sector numbers, so that it
+   takes no data sector and reading it takes no extra I/O.  Such
+   an inode has INODE_INLINE set in FLAGS.  When the file grows
+   past INLINE_MAX bytes, its data moves to a data sector. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    union
+      {
+        struct
+          {
+            block_sector_t direct[DIRECT_CNT]; /* Direct data sectors. */
+            block_sector_t indirect;           /* Indirect block. */
+            block_sector_t doubly_indirect;    /* Doubly indirect block. */
+          };
+        uint8_t inline_data[INLINE_MAX];       /* Inline data. */
+      };
+    uint32_t flags;                     /* INODE_* flags. */
   };
 
-/* Returns the number of sectors to allocate for an inode SIZE
-   bytes long. */
-static inline size_t
-bytes_to_sectors (off_t size)
-{
-  return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
-}
+/* In-memory inode.
+
+   Locking: open_inodes_lock protects ELEM and OPEN_CNT.  LOCK
+   protects the metadata members REMOVED and DENY_WRITE_CNT, and
+   serializes changes to DATA and to the inode's indirect blocks.
+   Changing DENY_WRITE_CNT also takes EXTEND_LOCK and RW for
+   writing, so a writer that holds either of those can check it
+   and then write without a race.
+   Each change to a sector number or to the length is a single
+   aligned store, so readers look them up without LOCK.
 
-/* In-memory inode. */
+   RW protects the contents of the data sectors below the end of
+   file: readers hold it for reading, so reads of a file proceed
+   in parallel, and writers within the file hold it for writing.
+   A write that extends the file holds EXTEND_LOCK instead while
+   it writes the sectors past the old end of file, which no
+   reader can see until it publishes the new length, so it does
+   not block readers.
+
+   DIR_LOCK serializes changes to directories.  Lock order is
+   DIR_LOCK, EXTEND_LOCK, RW, then LOCK; journal_begin() must
+   come before LOCK. */
 struct inode 
   {
     struct list_elem elem;              /* Element in inode list. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
+    struct lock lock;                   /* Protects metadata. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    bool journaled;                     /* Data written via journal? */
+    struct rwlock rw;                   /* Protects data sectors. */
+    struct lock extend_lock;            /* Serializes file growth. */
+    struct lock dir_lock;               /* Serializes directory changes. */
+    void *exec_cache;                   /* Executable metadata, if any. */
+    void (*exec_cache_free) (void *);   /* Frees EXEC_CACHE. */
     struct inode_disk data;             /* Inode content. */
   };
 
-/* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
-static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+/* The index blocks that lookup_sector() read most recently, so
+   that a read or write that spans many sectors reads each index
+   block once rather than once per sector.  A sector number of 0
+   means that nothing is cached at that level. */
+struct index_cache
+  {
+    block_sector_t outer_sector;        /* Cached doubly indirect block. */
+    block_sector_t outer[INDIRECT_CNT]; /* Its contents. */
+    block_sector_t inner_sector;        /* Cached indirect block. */
+    block_sector_t inner[INDIRECT_CNT]; /* Its contents. */
+  };
+
+static bool lookup_sector (const struct inode *, size_t idx,
+                           struct index_cache **, block_sector_t *);
+static bool install_sector (struct inode *, size_t idx, block_sector_t);
+static void release_sectors (struct inode_disk *);
+static off_t write_range (struct inode *, const uint8_t *, off_t size,
+                          off_t offset, off_t end);
+static off_t write_inline (struct inode *, const uint8_t *, off_t size,
+                           off_t offset);
+static bool migrate_inline (struct inode *);
+static bool begin_write (struct inode *);
+
+/* Returns true if INODE keeps its data inline.  INODE's RW must
+   be held, or else the answer may be stale: an inode can stop
+   being inline, but never becomes inline again. */
+static inline bool
+is_inline (const struct inode *inode) 
 {
-  ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+  return (inode->data.flags & INODE_INLINE) != 0;
+}
+
+/* Writes the BLOCK_SECTOR_SIZE bytes in BUFFER to SECTOR, either
+   through the journal, if JOURNALED is true, or in place. */
+static void
+write_sector (bool journaled, block_sector_t sector, const void *buffer) 
+{
+  if (journaled)
+    journal_write (sector, buffer);
   else
-    return -1;
+    block_write (fs_device, sector, buffer);
 }
 
 /* List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
 static struct list open_inodes;
+static struct lock open_inodes_lock;
+
+/* Cache of in-memory inodes. */
+static struct kmem_cache inode_cache;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  lock_init (&open_inodes_lock);
+  kmem_cache_init (&inode_cache, "inode", sizeof (struct inode), NULL, NULL);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The data starts out inline, if it fits, or as a
+   hole, so no data sectors are allocated or written.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails. */
 bool
 inode_create (block_sector_t sector, off_t length)
 {
@@ -84,22 +183,12 @@ inode_create (block_sector_t sector, off_t length)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+      if (length <= (off_t) INLINE_MAX)
+        disk_inode->flags = INODE_INLINE;
+      write_sector (true, sector, disk_inode);
+      success = true; 
       free (disk_inode);
     }
   return success;
@@ -114,6 +203,8 @@ inode_open (block_sector_t sector)
   struct list_elem *e;
   struct inode *inode;
 
+  lock_acquire (&open_inodes_lock);
+
   /* Check whether this inode is already open. */
   for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
        e = list_next (e)) 
@@ -121,23 +212,35 @@ inode_open (block_sector_t sector)
       inode = list_entry (e, struct inode, elem);
       if (inode->sector == sector) 
         {
-          inode_reopen (inode);
+          inode->open_cnt++;
+          lock_release (&open_inodes_lock);
           return inode; 
         }
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (&inode_cache);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
+  /* Initialize.  Reading the inode with open_inodes_lock held
+     keeps another thread from opening it at the same time. */
   list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
+  lock_init (&inode->lock);
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->journaled = false;
+  rwlock_init (&inode->rw);
+  lock_init (&inode->extend_lock);
+  lock_init (&inode->dir_lock);
+  inode->exec_cache = NULL;
+  journal_read (inode->sector, &inode->data);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +249,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -163,25 +270,35 @@ inode_get_inumber (const struct inode *inode)
 void
 inode_close (struct inode *inode) 
 {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_inodes_lock);
+  last = --inode->open_cnt == 0;
+  if (last)
+    list_remove (&inode->elem);
+  lock_release (&open_inodes_lock);
+
+  /* Release resources if this was the last opener.  No other
+     thread can reach INODE any longer, so no locks are needed. */
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+          journal_begin ();
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          if (!is_inline (inode))
+            release_sectors (&inode->data);
+          journal_end ();
         }
 
-      free (inode); 
+      if (inode->exec_cache != NULL)
+        inode->exec_cache_free (inode->exec_cache);
+      kmem_cache_free (&inode_cache, inode); 
     }
 }
 
@@ -191,23 +308,36 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&inode->lock);
   inode->removed = true;
+  lock_release (&inode->lock);
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+/* Reads SIZE bytes from INODE into BUFFER, starting at position
+   OFFSET, using *BOUNCE (allocated on first use) for partial
+   sectors and *INDEX (likewise) for index blocks.  The caller
+   must hold INODE's RW lock for reading.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+static off_t
+read_locked (struct inode *inode, uint8_t *buffer, off_t size, off_t offset,
+             uint8_t **bounce, struct index_cache **index) 
 {
-  uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
+  if (is_inline (inode))
+    {
+      off_t inode_left = inode_length (inode) - offset;
+      bytes_read = size < inode_left ? size : inode_left;
+      if (bytes_read < 0)
+        bytes_read = 0;
+      memcpy (buffer, inode->data.inline_data + offset, bytes_read);
+      size = 0;
+    }
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -220,23 +350,31 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      if (!lookup_sector (inode, offset / BLOCK_SECTOR_SIZE, index,
+                          &sector_idx))
+        break;
+      if (sector_idx == 0)
+        {
+          /* Hole: reads as zeros. */
+          memset (buffer + bytes_read, 0, chunk_size);
+        }
+      else if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
         {
           /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
+          journal_read (sector_idx, buffer + bytes_read);
         }
       else 
         {
           /* Read sector into bounce buffer, then partially copy
              into caller's buffer. */
-          if (bounce == NULL) 
+          if (*bounce == NULL) 
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
+              *bounce = malloc (BLOCK_SECTOR_SIZE);
+              if (*bounce == NULL)
                 break;
             }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          journal_read (sector_idx, *bounce);
+          memcpy (buffer + bytes_read, *bounce + sector_ofs, chunk_size);
         }
       
       /* Advance. */
@@ -244,47 +382,572 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       offset += chunk_size;
       bytes_read += chunk_size;
     }
+
+  return bytes_read;
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached. */
+off_t
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  uint8_t *bounce = NULL;
+  struct index_cache *index = NULL;
+  off_t bytes_read;
+
+  rwlock_acquire_read (&inode->rw);
+  bytes_read = read_locked (inode, buffer, size, offset, &bounce, &index);
+  rwlock_release_read (&inode->rw);
+  free (bounce);
+  free (index);
+
+  return bytes_read;
+}
+
+/* Reads from INODE, starting at position OFFSET, into the CNT
+   buffers described by IOV, filling each in turn.  Holds INODE's
+   RW lock across the whole vector, so the data read is a
+   consistent snapshot.  Returns the number of bytes actually
+   read, which is less than the vector's total size if an error
+   occurs or end of file is reached. */
+off_t
+inode_readv_at (struct inode *inode, const struct iovec *iov, int cnt,
+                off_t offset) 
+{
+  uint8_t *bounce = NULL;
+  struct index_cache *index = NULL;
+  off_t bytes_read = 0;
+  int i;
+
+  rwlock_acquire_read (&inode->rw);
+  for (i = 0; i < cnt; i++)
+    {
+      off_t size = iov[i].iov_len;
+      off_t retval = read_locked (inode, iov[i].iov_base, size,
+                                  offset + bytes_read, &bounce, &index);
+      bytes_read += retval;
+      if (retval != size)
+        break;
+    }
+  rwlock_release_read (&inode->rw);
   free (bounce);
+  free (index);
 
   return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk is full, the file reaches its
+   maximum size, or an error occurs.  A write past end of file
+   extends the file, leaving a hole between the old end of file
+   and OFFSET. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  off_t end = offset + size;
+  off_t length, split;
+  bool extending;
+  bool allowed = true;
+
+  /* Write inline data, or move it out of the inode if the write
+     goes past INLINE_MAX. */
+  if (is_inline (inode))
+    {
+      rwlock_acquire_write (&inode->rw);
+      if (!begin_write (inode))
+        {
+          rwlock_release_write (&inode->rw);
+          return 0;
+        }
+      if (is_inline (inode))
+        {
+          if (end <= (off_t) INLINE_MAX)
+            bytes_written = write_inline (inode, buffer, size, offset);
+          if (end <= (off_t) INLINE_MAX || !migrate_inline (inode))
+            {
+              rwlock_release_write (&inode->rw);
+              return bytes_written;
+            }
+        }
+      rwlock_release_write (&inode->rw);
+    }
+
+  /* Only extending writes change the length, so it cannot
+     change while we hold EXTEND_LOCK.  Without EXTEND_LOCK, it
+     can only grow, so a write that fits stays that way. */
+  extending = end > inode_length (inode);
+  if (extending)
+    lock_acquire (&inode->extend_lock);
+  length = inode_length (inode);
+
+  /* Bytes before SPLIT go in sectors that readers may see.
+     Bytes after it go in sectors wholly past end of file. */
+  split = extending ? (off_t) ROUND_UP (length, BLOCK_SECTOR_SIZE) : end;
+  if (split > end)
+    split = end;
+  if (split < offset)
+    split = offset;
 
+  if (offset < split)
+    {
+      rwlock_acquire_write (&inode->rw);
+      allowed = begin_write (inode);
+      if (allowed)
+        bytes_written = write_range (inode, buffer, split - offset, offset,
+                                     extending ? split : length);
+      rwlock_release_write (&inode->rw);
+    }
+  else if (extending)
+    allowed = begin_write (inode);
+  if (allowed && split < end && offset + bytes_written == split)
+    bytes_written += write_range (inode, buffer + bytes_written,
+                                  end - split, split, end);
+
+  if (extending)
+    {
+      /* Publish the new length only after the data is written. */
+      if (allowed && offset + bytes_written > length)
+        {
+          journal_begin ();
+          lock_acquire (&inode->lock);
+          inode->data.length = offset + bytes_written;
+          write_sector (true, inode->sector, &inode->data);
+          lock_release (&inode->lock);
+          journal_end ();
+        }
+      lock_release (&inode->extend_lock);
+    }
+
+  return bytes_written;
+}
+
+/* Writes the CNT buffers described by IOV into INODE, one after
+   another, starting at OFFSET.  A vector that lies within the
+   file's current length is written under a single acquisition
+   of INODE's RW lock; otherwise each buffer is written in turn
+   with inode_write_at().  Returns the number of bytes actually
+   written, which may be less than the vector's total size for
+   the same reasons as inode_write_at(). */
+off_t
+inode_writev_at (struct inode *inode, const struct iovec *iov, int cnt,
+                 off_t offset) 
+{
+  off_t bytes_written = 0;
+  off_t size = 0;
+  off_t length;
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    size += iov[i].iov_len;
+
+  rwlock_acquire_write (&inode->rw);
+  if (!begin_write (inode))
+    {
+      rwlock_release_write (&inode->rw);
+      return 0;
+    }
+  length = inode_length (inode);
+  if (is_inline (inode) || offset + size > length)
+    {
+      rwlock_release_write (&inode->rw);
+      for (i = 0; i < cnt; i++)
+        {
+          off_t retval = inode_write_at (inode, iov[i].iov_base,
+                                         iov[i].iov_len,
+                                         offset + bytes_written);
+          bytes_written += retval;
+          if (retval != (off_t) iov[i].iov_len)
+            break;
+        }
+      return bytes_written;
+    }
+
+  for (i = 0; i < cnt; i++)
+    {
+      off_t retval = write_range (inode, iov[i].iov_base, iov[i].iov_len,
+                                  offset + bytes_written, length);
+      bytes_written += retval;
+      if (retval != (off_t) iov[i].iov_len)
+        break;
+    }
+  rwlock_release_write (&inode->rw);
+
+  return bytes_written;
+}
+
+/* Checks whether INODE may be written.  If so, discards INODE's
+   executable metadata cache, since the write may change what it
+   describes, and returns true.  Returns false if writes are
+   denied.  The caller must hold INODE's RW for writing or its
+   EXTEND_LOCK until the write is done, so that writes cannot be
+   denied in the meantime. */
+static bool
+begin_write (struct inode *inode) 
+{
+  void *cache;
+
+  ASSERT (rwlock_held_for_write (&inode->rw)
+          || lock_held_by_current_thread (&inode->extend_lock));
+
+  lock_acquire (&inode->lock);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      lock_release (&inode->lock);
+      return false;
+    }
+  cache = inode->exec_cache;
+  inode->exec_cache = NULL;
+  lock_release (&inode->lock);
+
+  if (cache != NULL)
+    inode->exec_cache_free (cache);
+  return true;
+}
+
+/* Marks INODE as holding file system metadata, so that writes
+   to its data go through the journal. */
+void
+inode_set_journaled (struct inode *inode) 
+{
+  inode->journaled = true;
+}
+
+/* Disables writes to INODE, waiting for writes in progress to
+   finish.  May be called at most once per inode opener. */
+void
+inode_deny_write (struct inode *inode) 
+{
+  lock_acquire (&inode->extend_lock);
+  rwlock_acquire_write (&inode->rw);
+  lock_acquire (&inode->lock);
+  inode->deny_write_cnt++;
+  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&inode->lock);
+  rwlock_release_write (&inode->rw);
+  lock_release (&inode->extend_lock);
+}
+
+/* Re-enables writes to INODE.
+   Must be called once by each inode opener who has called
+   inode_deny_write() on the inode, before closing the inode. */
+void
+inode_allow_write (struct inode *inode) 
+{
+  lock_acquire (&inode->lock);
+  ASSERT (inode->deny_write_cnt > 0);
+  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  inode->deny_write_cnt--;
+  lock_release (&inode->lock);
+}
+
+/* Executable metadata cache.
+
+   The loader parses an executable's headers once and attaches
+   the result to its inode here, so that later loads of the same
+   file skip that work.  A cache is attached only while writes to
+   the inode are denied, that is, while some process is running
+   it, and the first write after the last inode_allow_write()
+   discards it.  So a cache, once found, stays valid as long as
+   the finder keeps writes denied. */
+
+/* Returns INODE's executable metadata cache, or a null pointer
+   if it has none. */
+void *
+inode_get_exec_cache (struct inode *inode) 
+{
+  void *cache;
+
+  lock_acquire (&inode->lock);
+  cache = inode->exec_cache;
+  lock_release (&inode->lock);
+  return cache;
+}
+
+/* Attaches CACHE to INODE as its executable metadata cache, to
+   be freed by calling FREE_CACHE (CACHE) when it is discarded.
+   Writes to INODE must be denied.  Returns false, without
+   attaching CACHE, if INODE already has a cache. */
+bool
+inode_set_exec_cache (struct inode *inode, void *cache,
+                      void (*free_cache) (void *)) 
+{
+  bool success = false;
+
+  lock_acquire (&inode->lock);
+  ASSERT (inode->deny_write_cnt > 0);
+  if (inode->exec_cache == NULL)
+    {
+      inode->exec_cache = cache;
+      inode->exec_cache_free = free_cache;
+      success = true;
+    }
+  lock_release (&inode->lock);
+  return success;
+}
+
+/* Returns true if INODE has been removed, so that it will be
+   deleted when it is last closed. */
+bool
+inode_is_removed (const struct inode *inode) 
+{
+  return inode->removed;
+}
+
+/* Returns the length, in bytes, of INODE's data. */
+off_t
+inode_length (const struct inode *inode)
+{
+  return inode->data.length;
+}
+
+/* Acquires INODE's directory lock, which serializes changes to
+   the directory that INODE holds. */
+void
+inode_lock_dir (struct inode *inode) 
+{
+  lock_acquire (&inode->dir_lock);
+}
+
+/* Releases INODE's directory lock. */
+void
+inode_unlock_dir (struct inode *inode) 
+{
+  lock_release (&inode->dir_lock);
+}
+
+/* Makes INDEX hold the contents of index block SECTOR, reading
+   it unless *CACHED, the sector whose contents INDEX already
+   holds, is SECTOR.  Returns false if SECTOR is 0, meaning that
+   the index block has not been allocated. */
+static bool
+read_index (block_sector_t *cached, block_sector_t index[INDIRECT_CNT],
+            block_sector_t sector) 
+{
+  if (sector == 0)
+    return false;
+  if (*cached != sector)
+    {
+      journal_read (sector, index);
+      *cached = sector;
+    }
+  return true;
+}
+
+/* Stores in *SECTORP the sector number of data sector IDX within
+   INODE, or 0 if that sector is a hole.  Index blocks are read
+   through *CACHE, which is allocated on first use and which the
+   caller must free().  Returns false if memory for *CACHE is
+   not available.
+
+   The cache is not updated when install_sector() changes an
+   index block, so it is only good for sectors that the caller
+   itself will not fill: a write must look up each sector before
+   it fills that sector, not after. */
+static bool
+lookup_sector (const struct inode *inode, size_t idx,
+               struct index_cache **cache, block_sector_t *sectorp) 
+{
+  struct index_cache *c;
+
+  if (idx < DIRECT_CNT)
+    {
+      *sectorp = inode->data.direct[idx];
+      return true;
+    }
+  idx -= DIRECT_CNT;
+
+  c = *cache;
+  if (c == NULL)
+    {
+      c = *cache = malloc (sizeof *c);
+      if (c == NULL)
+        return false;
+      c->outer_sector = c->inner_sector = 0;
+    }
+
+  *sectorp = 0;
+  if (idx < INDIRECT_CNT)
+    {
+      if (read_index (&c->inner_sector, c->inner, inode->data.indirect))
+        *sectorp = c->inner[idx];
+    }
+  else if (idx - INDIRECT_CNT < INDIRECT_CNT * INDIRECT_CNT)
+    {
+      idx -= INDIRECT_CNT;
+      if (read_index (&c->outer_sector, c->outer,
+                      inode->data.doubly_indirect)
+          && read_index (&c->inner_sector, c->inner,
+                         c->outer[idx / INDIRECT_CNT]))
+        *sectorp = c->inner[idx % INDIRECT_CNT];
+    }
+  return true;
+}
+
+/* Stores SECTOR as entry IDX of the indirect block whose sector
+   number is in *BLOCKP.  If *BLOCKP is 0, first allocates a new
+   indirect block, stores its sector number in *BLOCKP, and sets
+   *ALLOCATED to true; the caller must then write out the sector
+   that holds *BLOCKP.  Returns false if allocation fails. */
+static bool
+set_index_entry (block_sector_t *blockp, bool *allocated, size_t idx,
+                 block_sector_t sector) 
+{
+  block_sector_t index[INDIRECT_CNT];
+
+  *allocated = false;
+  if (*blockp == 0)
+    {
+      if (!free_map_allocate (1, blockp))
+        return false;
+      memset (index, 0, sizeof index);
+      *allocated = true;
+    }
+  else
+    journal_read (*blockp, index);
+
+  index[idx] = sector;
+  journal_write (*blockp, index);
+  return true;
+}
+
+/* Makes SECTOR data sector IDX within INODE, which must be a
+   hole, allocating indirect blocks as needed.  Returns true if
+   successful, false if disk allocation fails.
+   The caller must hold INODE's LOCK inside a journal_begin(). */
+static bool
+install_sector (struct inode *inode, size_t idx, block_sector_t sector) 
+{
+  struct inode_disk *data = &inode->data;
+  bool allocated;
+
+  ASSERT (lock_held_by_current_thread (&inode->lock));
+
+  if (idx < DIRECT_CNT)
+    {
+      data->direct[idx] = sector;
+      write_sector (true, inode->sector, data);
+      return true;
+    }
+  idx -= DIRECT_CNT;
+
+  if (idx < INDIRECT_CNT)
+    {
+      if (!set_index_entry (&data->indirect, &allocated, idx, sector))
+        return false;
+    }
+  else 
+    {
+      block_sector_t index[INDIRECT_CNT];
+      block_sector_t indirect = 0;
+      size_t outer = (idx - INDIRECT_CNT) / INDIRECT_CNT;
+      size_t inner = (idx - INDIRECT_CNT) % INDIRECT_CNT;
+
+      ASSERT (outer < INDIRECT_CNT);
+      if (data->doubly_indirect != 0)
+        {
+          journal_read (data->doubly_indirect, index);
+          indirect = index[outer];
+        }
+      if (!set_index_entry (&indirect, &allocated, inner, sector))
+        return false;
+      if (!allocated)
+        return true;
+      if (!set_index_entry (&data->doubly_indirect, &allocated,
+                            outer, indirect))
+        {
+          free_map_release (indirect, 1);
+          return false;
+        }
+    }
+
+  if (allocated)
+    write_sector (true, inode->sector, data);
+  return true;
+}
+
+/* Releases the sectors in the CNT-entry INDEX and, for DEPTH
+   greater than 1, the indirect blocks they point to in turn. */
+static void
+release_index (const block_sector_t *index, size_t cnt, int depth) 
+{
+  block_sector_t *child = NULL;
+  size_t i;
+
+  if (depth > 1)
+    {
+      child = malloc (BLOCK_SECTOR_SIZE);
+      if (child == NULL)
+        {
+          printf ("inode: out of memory, leaking sectors\n");
+          return;
+        }
+    }
+
+  for (i = 0; i < cnt; i++)
+    if (index[i] != 0)
+      {
+        if (depth > 1)
+          {
+            journal_read (index[i], child);
+            release_index (child, INDIRECT_CNT, depth - 1);
+          }
+        free_map_release (index[i], 1);
+      }
+
+  free (child);
+}
+
+/* Releases all the data sectors and indirect blocks of DATA. */
+static void
+release_sectors (struct inode_disk *data) 
+{
+  release_index (data->direct, DIRECT_CNT, 1);
+  release_index (&data->indirect, 1, 2);
+  release_index (&data->doubly_indirect, 1, 3);
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   but not past byte offset END.  Allocates a data sector for
+   each hole written.  Returns the number of bytes written. */
+static off_t
+write_range (struct inode *inode, const uint8_t *buffer, off_t size,
+             off_t offset, off_t end) 
+{
+  off_t bytes_written = 0;
+  uint8_t *bounce = NULL;
+  struct index_cache *index = NULL;
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      size_t idx = offset / BLOCK_SECTOR_SIZE;
+      block_sector_t sector_idx;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left before END, bytes left in sector, lesser of
+         the two. */
+      off_t inode_left = end - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually write into this sector. */
       int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      if (chunk_size <= 0 || idx >= MAX_SECTORS)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      if (!lookup_sector (inode, idx, &index, &sector_idx))
+        break;
+      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE
+          && sector_idx != 0)
         {
           /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          write_sector (inode->journaled, sector_idx,
+                        buffer + bytes_written);
         }
       else 
         {
@@ -298,13 +961,38 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
           /* If the sector contains data before or after the chunk
              we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
+             first.  Otherwise, or if the sector is a hole, we
+             start with a sector of all zeros. */
+          if (sector_idx != 0 && (sector_ofs > 0 || chunk_size < sector_left))
+            journal_read (sector_idx, bounce);
           else
             memset (bounce, 0, BLOCK_SECTOR_SIZE);
           memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+
+          if (sector_idx != 0)
+            write_sector (inode->journaled, sector_idx, bounce);
+          else
+            {
+              /* Fill the hole.  The data reaches disk before the
+                 journal can commit the sector number that makes
+                 it part of the file. */
+              bool success;
+
+              journal_begin ();
+              lock_acquire (&inode->lock);
+              success = free_map_allocate (1, &sector_idx);
+              if (success)
+                {
+                  write_sector (inode->journaled, sector_idx, bounce);
+                  success = install_sector (inode, idx, sector_idx);
+                  if (!success)
+                    free_map_release (sector_idx, 1);
+                }
+              lock_release (&inode->lock);
+              journal_end ();
+              if (!success)
+                break;
+            }
         }
 
       /* Advance. */
@@ -313,33 +1001,77 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       bytes_written += chunk_size;
     }
   free (bounce);
+  free (index);
 
   return bytes_written;
 }
 
-/* Disables writes to INODE.
-   May be called at most once per inode opener. */
-void
-inode_deny_write (struct inode *inode) 
+/* Writes SIZE bytes from BUFFER into INODE's inline data,
+   starting at OFFSET, extending the file if needed.  The write
+   must end within INLINE_MAX bytes.  Returns the number of bytes
+   written.  The caller must hold INODE's RW for writing. */
+static off_t
+write_inline (struct inode *inode, const uint8_t *buffer, off_t size,
+              off_t offset) 
 {
-  inode->deny_write_cnt++;
-  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
-}
+  /* Metadata inodes are written within a journal operation or a
+     commit already; other inodes need their own. */
+  bool op = !inode->journaled;
 
-/* Re-enables writes to INODE.
-   Must be called once by each inode opener who has called
-   inode_deny_write() on the inode, before closing the inode. */
-void
-inode_allow_write (struct inode *inode) 
-{
-  ASSERT (inode->deny_write_cnt > 0);
-  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
-  inode->deny_write_cnt--;
+  ASSERT (rwlock_held_for_write (&inode->rw));
+  ASSERT (offset + size <= (off_t) INLINE_MAX);
+
+  if (op)
+    journal_begin ();
+  lock_acquire (&inode->lock);
+  memcpy (inode->data.inline_data + offset, buffer, size);
+  if (offset + size > inode->data.length)
+    inode->data.length = offset + size;
+  write_sector (true, inode->sector, &inode->data);
+  lock_release (&inode->lock);
+  if (op)
+    journal_end ();
+
+  return size;
 }
 
-/* Returns the length, in bytes, of INODE's data. */
-off_t
-inode_length (const struct inode *inode)
+/* Moves INODE's inline data to a newly allocated data sector,
+   so that it can grow past INLINE_MAX bytes.  Returns true if
+   successful, false if disk or memory allocation fails.  The
+   caller must hold INODE's RW for writing. */
+static bool
+migrate_inline (struct inode *inode) 
 {
-  return inode->data.length;
+  uint8_t *bounce;
+  block_sector_t sector = 0;
+  bool success = true;
+
+  ASSERT (rwlock_held_for_write (&inode->rw));
+
+  bounce = calloc (1, BLOCK_SECTOR_SIZE);
+  if (bounce == NULL)
+    return false;
+  memcpy (bounce, inode->data.inline_data, INLINE_MAX);
+
+  journal_begin ();
+  lock_acquire (&inode->lock);
+  if (inode->data.length > 0)
+    {
+      /* Write the data before the inode that points to it. */
+      success = free_map_allocate (1, &sector);
+      if (success)
+        write_sector (inode->journaled, sector, bounce);
+    }
+  if (success)
+    {
+      memset (inode->data.inline_data, 0, INLINE_MAX);
+      inode->data.direct[0] = sector;
+      inode->data.flags &= ~INODE_INLINE;
+      write_sector (true, inode->sector, &inode->data);
+    }
+  lock_release (&inode->lock);
+  journal_end ();
+
+  free (bounce);
+  return success;
 }
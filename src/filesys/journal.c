@@ -0,0 +1,439 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/shutdown.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Write-ahead journal for file system metadata.
+
+   Metadata sectors (inodes, directories, and the free map) are
+   not written in place.  journal_write() instead stores a copy
+   of the new contents in an in-memory transaction, and
+   journal_read() returns the transaction's copy when there is
+   one.  Operations that must be atomic, such as creating or
+   removing a file, bracket their writes with journal_begin() and
+   journal_end().
+
+   journal_commit() groups all the writes made since the previous
+   commit into one transaction.  It waits for operations in
+   progress to end, copies the new sector contents into the log,
+   then writes the header sector, which names the home location
+   of each log sector.  Writing the header is the commit point:
+   after that the transaction survives a crash.  Finally it
+   copies the log to the home locations and clears the header.
+   The commit does its I/O without holding journal_lock, so
+   journal_read() can still find the committing transaction's
+   sectors, and writes made in the meantime go into a new
+   transaction.
+   At boot, journal_init() replays a header that names any
+   sectors, finishing a commit that a crash interrupted.
+
+   File data is written in place.  This is safe because the free
+   map does not reuse a sector freed in a transaction until that
+   transaction has committed and been copied to its home
+   locations.  Until then, a crash may bring back the file that
+   owned the sector, and the transaction may hold a copy of it
+   that the checkpoint would write over new data. */
+
+/* Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Number of log sectors, that is, maximum sectors per
+   transaction. */
+#define LOG_CNT (JOURNAL_SECTORS - 1)
+
+/* Sectors set aside for each operation in progress.  Creating
+   or removing a file writes at most an inode, a couple of
+   directory sectors, and their free map sectors. */
+#define OP_SECTORS 8
+
+/* On-disk journal header.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    unsigned magic;                     /* Magic number. */
+    uint32_t cnt;                       /* Committed sectors in log. */
+    block_sector_t targets[LOG_CNT];    /* Home location of each. */
+  };
+
+/* Number of slots in a transaction's hash table.  A power of 2
+   at least twice LOG_CNT, so that probe sequences stay short. */
+#define SLOT_CNT 256
+
+/* A metadata sector written in a transaction. */
+struct journal_entry
+  {
+    block_sector_t sector;              /* Home location. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* New contents. */
+  };
+
+/* A transaction. */
+struct transaction
+  {
+    struct journal_entry *entries[LOG_CNT]; /* In order of first write. */
+    size_t cnt;                         /* Number of entries. */
+    uint8_t slots[SLOT_CNT];            /* Open hash table, indexed by
+                                           sector, of 1 + indexes into
+                                           ENTRIES, or 0 if empty. */
+  };
+
+static struct transaction transactions[2];
+
+enum journal_crash journal_crash;
+
+static struct lock journal_lock;        /* Protects all of the below. */
+static struct condition journal_cond;   /* Signaled on state change. */
+static int active_cnt;                  /* Operations in progress. */
+static bool committing;                 /* Commit in progress? */
+static bool commit_wanted;              /* Commit once active_cnt is 0? */
+static struct transaction *current;     /* Takes new writes. */
+static struct transaction *committed;   /* Being written, or null. */
+static size_t free_map_sectors;         /* Sectors held for free map. */
+
+/* Header being written or read, kept off the stack. */
+static struct journal_header header;
+
+static void commit (enum journal_crash crash);
+static bool has_room (int op_cnt);
+static struct journal_entry *find_entry (const struct transaction *,
+                                         block_sector_t);
+static void add_entry (struct transaction *, struct journal_entry *);
+static void clear_transaction (struct transaction *);
+static void replay (void);
+static void write_header (const struct transaction *);
+
+/* Initializes the journal.  If FORMAT is true, writes an empty
+   journal; otherwise, replays any transaction that was committed
+   but not yet copied to its home locations. */
+void
+journal_init (bool format) 
+{
+  ASSERT (sizeof header == BLOCK_SECTOR_SIZE);
+
+  lock_init (&journal_lock);
+  cond_init (&journal_cond);
+  current = &transactions[0];
+
+  /* Every commit may add all of the free map's sectors. */
+  free_map_sectors = DIV_ROUND_UP (DIV_ROUND_UP (block_size (fs_device), 8),
+                                   BLOCK_SECTOR_SIZE) + 1;
+  if (!has_room (1))
+    PANIC ("file system device is too large for the journal");
+
+  if (format)
+    write_header (NULL);
+  else
+    replay ();
+}
+
+/* Commits the current transaction in preparation for shutdown.
+   If the "-jcrash" option was given, powers off in the middle of
+   the commit, as if the machine crashed, just before or just
+   after the commit point. */
+void
+journal_done (void) 
+{
+  commit (journal_crash);
+}
+
+/* Begins an operation whose writes must reach disk atomically.
+   Waits if a commit is in progress or if the current
+   transaction does not have room for another operation.  Also
+   waits for a commit if the space that the transaction would
+   free is more than the space that is free now, so that an
+   operation that needs the space can get it.  Operations may
+   nest; only the outermost one waits. */
+void
+journal_begin (void) 
+{
+  if (thread_current ()->journal_depth++ > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (committing || !has_room (active_cnt + 1) || free_map_short ())
+    {
+      if (!committing && active_cnt == 0)
+        {
+          /* The transaction is idle: commit it. */
+          lock_release (&journal_lock);
+          journal_commit ();
+          lock_acquire (&journal_lock);
+        }
+      else
+        {
+          if (!committing)
+            commit_wanted = true;
+          cond_wait (&journal_cond, &journal_lock);
+        }
+    }
+  active_cnt++;
+  lock_release (&journal_lock);
+}
+
+/* Ends an operation begun with journal_begin(). */
+void
+journal_end (void) 
+{
+  bool do_commit;
+
+  ASSERT (thread_current ()->journal_depth > 0);
+  if (--thread_current ()->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  ASSERT (active_cnt > 0);
+  active_cnt--;
+  do_commit = active_cnt == 0 && commit_wanted;
+  cond_broadcast (&journal_cond, &journal_lock);
+  lock_release (&journal_lock);
+
+  if (do_commit)
+    journal_commit ();
+}
+
+/* Reads SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes, returning the copy in the current
+   transaction or the one being committed, if there is one. */
+void
+journal_read (block_sector_t sector, void *buffer) 
+{
+  struct journal_entry *e;
+
+  lock_acquire (&journal_lock);
+  e = find_entry (current, sector);
+  if (e == NULL && committed != NULL)
+    e = find_entry (committed, sector);
+  if (e != NULL)
+    memcpy (buffer, e->data, BLOCK_SECTOR_SIZE);
+  lock_release (&journal_lock);
+
+  if (e == NULL)
+    block_read (fs_device, sector, buffer);
+}
+
+/* Adds the BLOCK_SECTOR_SIZE bytes in BUFFER to the current
+   transaction as the new contents of metadata sector SECTOR. */
+void
+journal_write (block_sector_t sector, const void *buffer) 
+{
+  struct journal_entry *e;
+
+  lock_acquire (&journal_lock);
+  e = find_entry (current, sector);
+  if (e == NULL)
+    {
+      if (current->cnt >= LOG_CNT)
+        PANIC ("journal overflow");
+      e = malloc (sizeof *e);
+      if (e == NULL)
+        PANIC ("out of memory for journal");
+      e->sector = sector;
+      add_entry (current, e);
+    }
+  memcpy (e->data, buffer, BLOCK_SECTOR_SIZE);
+  lock_release (&journal_lock);
+}
+
+/* Commits the current transaction and writes it to the home
+   locations of its sectors. */
+void
+journal_commit (void) 
+{
+  commit (JOURNAL_CRASH_NONE);
+}
+
+/* Returns true if the current transaction holds any writes.
+   Safe to call from an interrupt handler, but the answer may be
+   stale by the time it is used. */
+bool
+journal_dirty (void) 
+{
+  return current->cnt > 0;
+}
+
+/* Commits the current transaction.  If CRASH is not
+   JOURNAL_CRASH_NONE, powers off just before or just after the
+   commit point. */
+static void
+commit (enum journal_crash crash) 
+{
+  struct transaction *txn;
+  size_t i;
+
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&journal_cond, &journal_lock);
+  committing = true;
+  commit_wanted = false;
+  while (active_cnt > 0)
+    cond_wait (&journal_cond, &journal_lock);
+  lock_release (&journal_lock);
+
+  /* Pull pending free map changes into the transaction.  New
+     operations cannot begin while we are committing, so the
+     free map matches the metadata being committed. */
+  if (!free_map_sync ())
+    printf ("journal: free map write failed\n");
+
+  /* Set the transaction aside, so that we can write it without
+     holding journal_lock. */
+  lock_acquire (&journal_lock);
+  txn = current;
+  committed = txn;
+  current = txn == &transactions[0] ? &transactions[1] : &transactions[0];
+  lock_release (&journal_lock);
+
+  if (txn->cnt > 0)
+    {
+      /* Write the log, then the header that commits it. */
+      for (i = 0; i < txn->cnt; i++)
+        block_write (fs_device, JOURNAL_SECTOR + 1 + i,
+                     txn->entries[i]->data);
+      if (crash == JOURNAL_CRASH_BEFORE)
+        {
+          printf ("journal: crashing before commit of %zu sectors\n",
+                  txn->cnt);
+          shutdown_power_off_now ();
+        }
+      write_header (txn);
+
+      if (crash == JOURNAL_CRASH_AFTER)
+        {
+          printf ("journal: crashing after commit of %zu sectors\n",
+                  txn->cnt);
+          shutdown_power_off_now ();
+        }
+
+      /* Checkpoint. */
+      for (i = 0; i < txn->cnt; i++)
+        block_write (fs_device, txn->entries[i]->sector,
+                     txn->entries[i]->data);
+      write_header (NULL);
+    }
+
+  /* The home locations are up to date, so readers no longer need
+     the transaction. */
+  lock_acquire (&journal_lock);
+  committed = NULL;
+  lock_release (&journal_lock);
+  clear_transaction (txn);
+
+  /* The sectors freed by the transaction may be reused now.
+     free_map_lock comes before journal_lock, so we can't hold
+     journal_lock here, but no operation can begin until we
+     clear COMMITTING. */
+  free_map_commit ();
+
+  lock_acquire (&journal_lock);
+  committing = false;
+  cond_broadcast (&journal_cond, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Returns true if the current transaction has room for OP_CNT
+   operations in progress in addition to the sectors it holds. */
+static bool
+has_room (int op_cnt) 
+{
+  return current->cnt + free_map_sectors + op_cnt * OP_SECTORS <= LOG_CNT;
+}
+
+/* Returns the entry for SECTOR in TXN, or a null pointer if TXN
+   does not hold SECTOR.  journal_lock must be held. */
+static struct journal_entry *
+find_entry (const struct transaction *txn, block_sector_t sector) 
+{
+  size_t slot;
+
+  for (slot = hash_int (sector) % SLOT_CNT; txn->slots[slot] != 0;
+       slot = (slot + 1) % SLOT_CNT)
+    {
+      struct journal_entry *e = txn->entries[txn->slots[slot] - 1];
+      if (e->sector == sector)
+        return e;
+    }
+  return NULL;
+}
+
+/* Adds E, which TXN must not already hold, to TXN.
+   journal_lock must be held. */
+static void
+add_entry (struct transaction *txn, struct journal_entry *e) 
+{
+  size_t slot;
+
+  ASSERT (txn->cnt < LOG_CNT);
+
+  for (slot = hash_int (e->sector) % SLOT_CNT; txn->slots[slot] != 0;
+       slot = (slot + 1) % SLOT_CNT)
+    continue;
+  txn->entries[txn->cnt++] = e;
+  txn->slots[slot] = txn->cnt;
+}
+
+/* Frees TXN's entries and makes it empty.  TXN must not be
+   visible to other threads. */
+static void
+clear_transaction (struct transaction *txn) 
+{
+  size_t i;
+
+  for (i = 0; i < txn->cnt; i++)
+    free (txn->entries[i]);
+  txn->cnt = 0;
+  memset (txn->slots, 0, sizeof txn->slots);
+}
+
+/* Copies a committed transaction found in the journal to the
+   home locations of its sectors. */
+static void
+replay (void) 
+{
+  uint8_t *buffer;
+  size_t i;
+
+  block_read (fs_device, JOURNAL_SECTOR, &header);
+  if (header.magic != JOURNAL_MAGIC)
+    PANIC ("file system has no journal (reformat it with -f)");
+  if (header.cnt == 0)
+    return;
+  if (header.cnt > LOG_CNT)
+    PANIC ("journal header is corrupt");
+
+  printf ("journal: replaying %u sectors\n", (unsigned) header.cnt);
+  buffer = malloc (BLOCK_SECTOR_SIZE);
+  if (buffer == NULL)
+    PANIC ("out of memory for journal replay");
+  for (i = 0; i < header.cnt; i++)
+    {
+      block_read (fs_device, JOURNAL_SECTOR + 1 + i, buffer);
+      block_write (fs_device, header.targets[i], buffer);
+    }
+  free (buffer);
+  write_header (NULL);
+}
+
+/* Writes a journal header naming TXN's entries, or an empty
+   header if TXN is a null pointer. */
+static void
+write_header (const struct transaction *txn) 
+{
+  size_t i;
+
+  memset (&header, 0, sizeof header);
+  header.magic = JOURNAL_MAGIC;
+  if (txn != NULL)
+    {
+      header.cnt = txn->cnt;
+      for (i = 0; i < txn->cnt; i++)
+        header.targets[i] = txn->entries[i]->sector;
+    }
+  block_write (fs_device, JOURNAL_SECTOR, &header);
+}
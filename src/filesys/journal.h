@@ -0,0 +1,32 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Reserved region of the file system device that holds the
+   journal: a header sector followed by the log. */
+#define JOURNAL_SECTOR 2        /* Journal header sector. */
+#define JOURNAL_SECTORS 127     /* Sectors in the journal region. */
+
+/* Where the final commit at shutdown stops, as if the machine
+   crashed there.  Controlled by kernel command-line option
+   "-jcrash". */
+enum journal_crash
+  {
+    JOURNAL_CRASH_NONE,         /* Finish the commit. */
+    JOURNAL_CRASH_BEFORE,       /* Stop before the commit record. */
+    JOURNAL_CRASH_AFTER         /* Stop after the commit record. */
+  };
+extern enum journal_crash journal_crash;
+
+void journal_init (bool format);
+void journal_done (void);
+void journal_begin (void);
+void journal_end (void);
+void journal_read (block_sector_t, void *);
+void journal_write (block_sector_t, const void *);
+void journal_commit (void);
+bool journal_dirty (void);
+
+#endif /* filesys/journal.h */
@@ -358,6 +358,28 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the part of B that holds the CNT bits starting at
+   START to FILE, at the same offset that bitmap_write() would
+   write it.  Return true if successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+                    size_t start, size_t cnt)
+{
+  off_t ofs, end;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  if (cnt > b->bit_cnt - start)
+    cnt = b->bit_cnt - start;
+  if (cnt == 0)
+    return true;
+
+  ofs = elem_idx (start) * sizeof (elem_type);
+  end = byte_cnt (start + cnt);
+  return file_write_at (file, (uint8_t *) b->bits + ofs, end - ofs, ofs)
+         == end - ofs;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
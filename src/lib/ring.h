@@ -0,0 +1,62 @@
+#ifndef __LIB_RING_H
+#define __LIB_RING_H
+
+#include <stdint.h>
+
+/* Submission and completion rings.
+
+   A process may register one page-aligned struct ring with
+   ring_setup().  It queues operations by filling in entries of
+   SQ[] and advancing SQ_TAIL, then calls ring_enter() to have
+   the kernel carry out a whole batch in one system call.  The
+   kernel consumes entries at SQ_HEAD and posts one completion per
+   operation, in order, at CQ_TAIL.  The process reaps them from
+   CQ_HEAD.
+
+   All four indexes run freely and wrap around at 2**32; an
+   index refers to array element (index % ENTRIES).  Each index
+   is written only by its owner (noted below) and only after the
+   entry it covers is complete. */
+
+/* Ring sizes.  Both must be powers of 2. */
+#define RING_SQ_ENTRIES 64
+#define RING_CQ_ENTRIES 128
+
+/* Operations. */
+enum ring_opcode
+  {
+    RING_NOP,                   /* Do nothing; result is 0. */
+    RING_READ,                  /* Like read() or pread(). */
+    RING_WRITE                  /* Like write() or pwrite(). */
+  };
+
+/* Submission queue entry. */
+struct ring_sqe
+  {
+    int opcode;                 /* A RING_* operation. */
+    int fd;                     /* File descriptor. */
+    void *buf;                  /* Data buffer. */
+    unsigned len;               /* Bytes to transfer. */
+    int ofs;                    /* File offset, or -1 for file position. */
+    unsigned user_data;         /* Copied to the completion. */
+  };
+
+/* Completion queue entry. */
+struct ring_cqe
+  {
+    unsigned user_data;         /* From the submission. */
+    int result;                 /* Bytes transferred, or -1. */
+  };
+
+/* A pair of rings, shared between a process and the kernel. */
+struct ring
+  {
+    volatile uint32_t sq_head;  /* Next to consume.  Kernel. */
+    volatile uint32_t sq_tail;  /* Next to fill.  Process. */
+    volatile uint32_t cq_head;  /* Next to reap.  Process. */
+    volatile uint32_t cq_tail;  /* Next to post.  Kernel. */
+    struct ring_sqe sq[RING_SQ_ENTRIES];
+    struct ring_cqe cq[RING_CQ_ENTRIES];
+  };
+
+#endif /* lib/ring.h */
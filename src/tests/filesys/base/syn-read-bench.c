@@ -0,0 +1,43 @@
+/* Spawns 1, 2, 4, and then 8 child processes that all read the
+   same file a byte at a time, and reports the cycles each round
+   takes.  With per-inode reader locks the readers proceed in
+   parallel, so the time per round should grow more slowly than
+   the number of readers. */
+
+#include <random.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/base/syn-read.h"
+
+static char buf[BUF_SIZE];
+
+#define MAX_CHILDREN 8
+
+void
+test_main (void) 
+{
+  pid_t children[MAX_CHILDREN];
+  size_t child_cnt;
+  int fd;
+
+  CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  random_bytes (buf, sizeof buf);
+  CHECK (write (fd, buf, sizeof buf) > 0, "write \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  for (child_cnt = 1; child_cnt <= MAX_CHILDREN; child_cnt *= 2)
+    {
+      uint64_t start = rdtsc ();
+
+      quiet = true;
+      exec_children ("child-syn-read", children, child_cnt);
+      wait_children (children, child_cnt);
+      quiet = false;
+
+      msg ("%zu readers: %llu cycles", child_cnt, rdtsc () - start);
+    }
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_benchmark (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-read-bench) begin
+(syn-read-bench) create "data"
+(syn-read-bench) open "data"
+(syn-read-bench) write "data"
+(syn-read-bench) close "data"
+(syn-read-bench) 1 readers
+(syn-read-bench) 2 readers
+(syn-read-bench) 4 readers
+(syn-read-bench) 8 readers
+(syn-read-bench) end
+EOF
+pass;
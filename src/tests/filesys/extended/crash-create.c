@@ -0,0 +1,18 @@
+/* Creates and removes files, then shuts down with the "-jcrash"
+   kernel option, which powers off after the final journal commit
+   is written but before it is copied into place.  The
+   persistence check verifies that replaying the journal at the
+   next boot recovers every change. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK (create ("b", 0), "create \"b\"");
+  CHECK (create ("c", 0), "create \"c\"");
+  CHECK (remove ("b"), "remove \"b\"");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(crash-create) begin
+(crash-create) create "a"
+(crash-create) create "b"
+(crash-create) create "c"
+(crash-create) remove "b"
+(crash-create) end
+EOF
+pass;
@@ -0,0 +1,64 @@
+/* Writes file "a", fills the disk with a second file and removes
+   it, then removes "a" and writes a new file "b" of the same
+   size.  Shuts down with the "-jcrash=before" kernel option,
+   which powers off after the final journal transaction is
+   logged but before it is committed.
+
+   Freeing most of the disk makes the journal commit before the
+   next operation, so the crash rolls back just the removal of
+   "a" and the creation of "b".  The persistence check verifies
+   that "a" survives with its original contents, which requires
+   that "b" not have been written into the sectors that "a" gave
+   up. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 4096
+#define CHUNK_SIZE 4096
+
+static char buf_a[FILE_SIZE];
+static char buf_b[FILE_SIZE];
+static char chunk[CHUNK_SIZE];
+
+/* Creates FILE_NAME and writes the FILE_SIZE bytes in BUF to
+   it. */
+static void
+write_file (const char *file_name, const char *buf) 
+{
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, FILE_SIZE) == FILE_SIZE,
+         "write \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_init (0);
+  random_bytes (buf_a, sizeof buf_a);
+  random_bytes (buf_b, sizeof buf_b);
+
+  write_file ("a", buf_a);
+
+  CHECK (create ("fill", 0), "create \"fill\"");
+  CHECK ((fd = open ("fill")) > 1, "open \"fill\"");
+  msg ("fill the disk");
+  while (write (fd, chunk, sizeof chunk) == (int) sizeof chunk)
+    continue;
+  msg ("close \"fill\"");
+  close (fd);
+  CHECK (remove ("fill"), "remove \"fill\"");
+
+  CHECK (remove ("a"), "remove \"a\"");
+  write_file ("b", buf_b);
+  check_file ("b", buf_b, FILE_SIZE);
+}
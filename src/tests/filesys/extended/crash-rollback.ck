@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(crash-rollback) begin
+(crash-rollback) create "a"
+(crash-rollback) open "a"
+(crash-rollback) write "a"
+(crash-rollback) close "a"
+(crash-rollback) create "fill"
+(crash-rollback) open "fill"
+(crash-rollback) fill the disk
+(crash-rollback) close "fill"
+(crash-rollback) remove "fill"
+(crash-rollback) remove "a"
+(crash-rollback) create "b"
+(crash-rollback) open "b"
+(crash-rollback) write "b"
+(crash-rollback) close "b"
+(crash-rollback) open "b" for verification
+(crash-rollback) verified contents of "b"
+(crash-rollback) close "b"
+(crash-rollback) end
+EOF
+pass;
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($data) = random_bytes (1000);
+check_archive ({"tiny" => [substr ($data, 0, 100)], "small" => [$data]});
+pass;
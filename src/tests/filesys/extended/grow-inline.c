@@ -0,0 +1,47 @@
+/* Writes a file small enough to be kept inline in its inode,
+   then grows a second file from inline size to past the inline
+   limit, checking the contents at each step. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TINY_SIZE 100
+#define SMALL_SIZE 400
+#define FILE_SIZE 1000
+
+static char buf[FILE_SIZE];
+
+/* Writes SIZE bytes from buf at offset OFS in FILE_NAME, which is
+   open as FD. */
+static void
+write_some (int fd, const char *file_name, size_t ofs, size_t size) 
+{
+  CHECK (write (fd, buf + ofs, size) == (int) size,
+         "write %zu bytes at offset %zu in \"%s\"", size, ofs, file_name);
+}
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create ("tiny", 0), "create \"tiny\"");
+  CHECK ((fd = open ("tiny")) > 1, "open \"tiny\"");
+  write_some (fd, "tiny", 0, TINY_SIZE);
+  msg ("close \"tiny\"");
+  close (fd);
+  check_file ("tiny", buf, TINY_SIZE);
+
+  CHECK (create ("small", 0), "create \"small\"");
+  CHECK ((fd = open ("small")) > 1, "open \"small\"");
+  write_some (fd, "small", 0, SMALL_SIZE);
+  check_file ("small", buf, SMALL_SIZE);
+  write_some (fd, "small", SMALL_SIZE, FILE_SIZE - SMALL_SIZE);
+  msg ("close \"small\"");
+  close (fd);
+  check_file ("small", buf, FILE_SIZE);
+}
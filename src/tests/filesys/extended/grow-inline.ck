@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-inline) begin
+(grow-inline) create "tiny"
+(grow-inline) open "tiny"
+(grow-inline) write 100 bytes at offset 0 in "tiny"
+(grow-inline) close "tiny"
+(grow-inline) open "tiny" for verification
+(grow-inline) verified contents of "tiny"
+(grow-inline) close "tiny"
+(grow-inline) create "small"
+(grow-inline) open "small"
+(grow-inline) write 400 bytes at offset 0 in "small"
+(grow-inline) open "small" for verification
+(grow-inline) verified contents of "small"
+(grow-inline) close "small"
+(grow-inline) write 600 bytes at offset 400 in "small"
+(grow-inline) close "small"
+(grow-inline) open "small" for verification
+(grow-inline) verified contents of "small"
+(grow-inline) close "small"
+(grow-inline) end
+EOF
+pass;
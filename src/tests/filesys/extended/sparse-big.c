@@ -0,0 +1,80 @@
+/* Creates a file twice the size of the file system, which fits
+   only because unwritten ranges are holes that take no disk
+   space.  Checks that the holes read as zeros and that a sector
+   written in the middle reads back.  Then fills the disk by
+   writing the start of the file, removes it, and checks that
+   removing it freed its space by writing as much again into a
+   new file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (4 * 1024 * 1024)
+#define CHUNK_SIZE 512
+
+static char zeros[CHUNK_SIZE];
+static char buf[CHUNK_SIZE];
+
+/* Reads CHUNK_SIZE bytes at OFS in FD and compares them against
+   EXPECTED. */
+static void
+check_chunk (int fd, const char *file_name, size_t ofs, const char *expected)
+{
+  seek (fd, ofs);
+  CHECK (read (fd, buf, sizeof buf) == (int) sizeof buf,
+         "read %d bytes at offset %d in \"%s\"",
+         (int) sizeof buf, (int) ofs, file_name);
+  compare_bytes (buf, expected, sizeof buf, ofs, file_name);
+}
+
+void
+test_main (void) 
+{
+  const char *file_name = "scratch";
+  static char data[CHUNK_SIZE];
+  size_t fill_size, ofs;
+  int fd;
+
+  memset (data, 'a', sizeof data);
+
+  CHECK (create (file_name, FILE_SIZE), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (filesize (fd) == FILE_SIZE, "filesize \"%s\"", file_name);
+  check_chunk (fd, file_name, 0, zeros);
+  check_chunk (fd, file_name, FILE_SIZE - CHUNK_SIZE, zeros);
+
+  msg ("seek \"%s\"", file_name);
+  seek (fd, FILE_SIZE / 2);
+  CHECK (write (fd, data, sizeof data) == (int) sizeof data,
+         "write \"%s\"", file_name);
+  check_chunk (fd, file_name, FILE_SIZE / 2, data);
+  check_chunk (fd, file_name, FILE_SIZE / 2 - CHUNK_SIZE, zeros);
+  check_chunk (fd, file_name, FILE_SIZE / 2 + CHUNK_SIZE, zeros);
+
+  msg ("fill the disk");
+  seek (fd, 0);
+  fill_size = 0;
+  while (write (fd, data, sizeof data) == (int) sizeof data)
+    fill_size += sizeof data;
+  if (fill_size >= FILE_SIZE / 2)
+    fail ("wrote %zu bytes without filling the disk", fill_size);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  CHECK (remove (file_name), "remove \"%s\"", file_name);
+
+  /* This file needs no more space than the one just removed. */
+  file_name = "refill";
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  msg ("write as much into \"%s\"", file_name);
+  for (ofs = 0; ofs < fill_size; ofs += sizeof data)
+    if (write (fd, data, sizeof data) != (int) sizeof data)
+      fail ("write at offset %zu in \"%s\" failed: space not freed",
+            ofs, file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  CHECK (remove (file_name), "remove \"%s\"", file_name);
+}
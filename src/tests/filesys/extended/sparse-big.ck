@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sparse-big) begin
+(sparse-big) create "scratch"
+(sparse-big) open "scratch"
+(sparse-big) filesize "scratch"
+(sparse-big) read 512 bytes at offset 0 in "scratch"
+(sparse-big) read 512 bytes at offset 4193792 in "scratch"
+(sparse-big) seek "scratch"
+(sparse-big) write "scratch"
+(sparse-big) read 512 bytes at offset 2097152 in "scratch"
+(sparse-big) read 512 bytes at offset 2096640 in "scratch"
+(sparse-big) read 512 bytes at offset 2097664 in "scratch"
+(sparse-big) fill the disk
+(sparse-big) close "scratch"
+(sparse-big) remove "scratch"
+(sparse-big) create "refill"
+(sparse-big) open "refill"
+(sparse-big) write as much into "refill"
+(sparse-big) close "refill"
+(sparse-big) remove "refill"
+(sparse-big) end
+EOF
+pass;
@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"child-syn-rw" => "tests/filesys/extended/child-syn-rw"});
+pass;
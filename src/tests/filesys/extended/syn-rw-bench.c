@@ -0,0 +1,51 @@
+/* Rewrites a file in place, in chunks, while 1, 2, 4, and then 8
+   child processes read it, and reports the cycles each round
+   takes.  The file is written in full before the readers start
+   and each rewrite stores the same bytes, so the readers always
+   see the expected contents.  Readers share the file's lock and
+   wait only while a chunk is being written, so the time per
+   round should grow more slowly than the number of readers. */
+
+#include <random.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-rw.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+char buf[BUF_SIZE];
+
+#define MAX_CHILDREN 8
+
+void
+test_main (void) 
+{
+  pid_t children[MAX_CHILDREN];
+  size_t child_cnt;
+
+  random_bytes (buf, sizeof buf);
+  for (child_cnt = 1; child_cnt <= MAX_CHILDREN; child_cnt *= 2)
+    {
+      uint64_t start = rdtsc ();
+      size_t ofs;
+      int fd;
+
+      quiet = true;
+      CHECK (create (file_name, BUF_SIZE), "create \"%s\"", file_name);
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      CHECK (write (fd, buf, BUF_SIZE) == BUF_SIZE,
+             "write %d bytes to \"%s\"", BUF_SIZE, file_name);
+      seek (fd, 0);
+      exec_children ("child-syn-rw", children, child_cnt);
+      for (ofs = 0; ofs < BUF_SIZE; ofs += CHUNK_SIZE)
+        CHECK (write (fd, buf + ofs, CHUNK_SIZE) > 0,
+               "write %d bytes at offset %zu in \"%s\"",
+               (int) CHUNK_SIZE, ofs, file_name);
+      wait_children (children, child_cnt);
+      close (fd);
+      CHECK (remove (file_name), "remove \"%s\"", file_name);
+      quiet = false;
+
+      msg ("%zu readers: %llu cycles", child_cnt, rdtsc () - start);
+    }
+}
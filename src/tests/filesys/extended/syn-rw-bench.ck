@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_benchmark (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-rw-bench) begin
+(syn-rw-bench) 1 readers
+(syn-rw-bench) 2 readers
+(syn-rw-bench) 4 readers
+(syn-rw-bench) 8 readers
+(syn-rw-bench) end
+EOF
+pass;
@@ -33,6 +33,27 @@ sub check_expected {
     compare_output ("run", @options, \@output, $expected);
 }
 
+# Like check_expected, for benchmarks.  Their output lines of
+# the form "(test) label: N cycles ..." are reduced to
+# "(test) label" before comparing, since cycle counts vary from
+# run to run.
+sub check_benchmark {
+    my ($expected) = pop @_;
+    my (@options) = @_;
+    my (@output) = read_text_file ("$test.output");
+    common_checks ("run", @output);
+    @output = drop_cycles (@output);
+    compare_output ("run", @options, \@output, $expected);
+}
+
+# Strips cycle counts from benchmark output lines in OUTPUT, as
+# described for check_benchmark, and returns the result.
+sub drop_cycles {
+    my (@output) = @_;
+    s/^(\([^)]*\) [^:]*): \d+ cycles\b.*$/$1/ foreach @output;
+    return @output;
+}
+
 sub common_checks {
     my ($run, @output) = @_;
 
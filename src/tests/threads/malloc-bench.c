@@ -0,0 +1,113 @@
+/* Measures malloc() and free() throughput with many kernel
+   threads allocating and freeing small blocks at the same time.
+   Each thread keeps a working set of blocks of random sizes and
+   repeatedly replaces a random one of them, checking that no
+   other thread has scribbled on its blocks.  The test reports
+   the average cost, in CPU cycles, of a malloc()/free() pair. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <random.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Number of threads. */
+#define THREAD_CNT 16
+
+/* Blocks held by each thread at once. */
+#define BLOCK_CNT 32
+
+/* Largest block allocated, in bytes. */
+#define MAX_SIZE 512
+
+/* malloc()/free() pairs per thread. */
+#define OP_CNT 2000
+
+struct bench_thread
+  {
+    int id;                             /* Thread number. */
+    unsigned seed;                      /* Random seed. */
+    struct semaphore *done;             /* Upped when finished. */
+    bool ok;                            /* Did it see any corruption? */
+  };
+
+static thread_func bench_thread;
+
+void
+test_malloc_bench (void) 
+{
+  static struct bench_thread threads[THREAD_CNT];
+  struct semaphore done;
+  uint64_t start, cycles;
+  int i;
+
+  sema_init (&done, 0);
+  random_init (0);
+
+  start = rdtsc ();
+  for (i = 0; i < THREAD_CNT; i++) 
+    {
+      struct bench_thread *t = &threads[i];
+      char name[16];
+
+      t->id = i;
+      t->seed = random_ulong ();
+      t->done = &done;
+      t->ok = true;
+      snprintf (name, sizeof name, "bench %d", i);
+      thread_create (name, PRI_DEFAULT, bench_thread, t);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+  cycles = rdtsc () - start;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    if (!threads[i].ok)
+      fail ("thread %d found a corrupted block", i);
+
+  msg ("%d threads: %llu cycles per malloc/free",
+       THREAD_CNT, cycles / (THREAD_CNT * OP_CNT));
+  pass ();
+}
+
+static void
+bench_thread (void *t_) 
+{
+  struct bench_thread *t = t_;
+  uint8_t *blocks[BLOCK_CNT];
+  size_t sizes[BLOCK_CNT];
+  int i;
+
+  memset (blocks, 0, sizeof blocks);
+  for (i = 0; i < OP_CNT; i++) 
+    {
+      /* A cheap per-thread random number generator, so that
+         threads do not share state. */
+      int slot;
+
+      t->seed = t->seed * 1103515245 + 12345;
+      slot = (t->seed >> 16) % BLOCK_CNT;
+      if (blocks[slot] != NULL) 
+        {
+          if (blocks[slot][0] != t->id
+              || blocks[slot][sizes[slot] - 1] != t->id)
+            t->ok = false;
+          free (blocks[slot]);
+        }
+
+      sizes[slot] = (t->seed >> 8) % MAX_SIZE + 1;
+      blocks[slot] = malloc (sizes[slot]);
+      if (blocks[slot] == NULL)
+        t->ok = false;
+      else
+        memset (blocks[slot], t->id, sizes[slot]);
+    }
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    free (blocks[i]);
+  sema_up (t->done);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_benchmark ([<<'EOF']);
+(malloc-bench) begin
+(malloc-bench) 16 threads
+(malloc-bench) PASS
+(malloc-bench) end
+EOF
+pass;
@@ -0,0 +1,119 @@
+/* Stresses the page allocator with a random mix of multi-page
+   allocations and frees, then checks that freeing everything
+   coalesces the pool back into blocks as large as it started
+   with.  Also reports the average cost, in CPU cycles, of an
+   allocation and of a free, to track allocator latency. */
+
+#include <stdint.h>
+#include <random.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+
+/* Number of blocks allocated at once, at most. */
+#define SLOT_CNT 64
+
+/* Largest block allocated, in pages. */
+#define MAX_PAGES 5
+
+/* Number of random operations. */
+#define OP_CNT 4096
+
+struct slot
+  {
+    uint8_t *pages;             /* Allocated pages, or null. */
+    size_t page_cnt;            /* Number of pages. */
+  };
+
+static size_t largest_block (void);
+static void check_fill (const struct slot *, uint8_t value);
+
+void
+test_palloc_stress (void) 
+{
+  static struct slot slots[SLOT_CNT];
+  uint64_t alloc_cycles = 0, free_cycles = 0;
+  unsigned alloc_cnt = 0, free_cnt = 0;
+  size_t before, after;
+  int i;
+
+  before = largest_block ();
+
+  random_init (0);
+  for (i = 0; i < OP_CNT; i++) 
+    {
+      struct slot *s = &slots[random_ulong () % SLOT_CNT];
+      uint64_t start;
+
+      if (s->pages == NULL) 
+        {
+          s->page_cnt = random_ulong () % MAX_PAGES + 1;
+          start = rdtsc ();
+          s->pages = palloc_get_multiple (0, s->page_cnt);
+          alloc_cycles += rdtsc () - start;
+          alloc_cnt++;
+          if (s->pages == NULL)
+            fail ("failed to allocate %zu pages", s->page_cnt);
+          memset (s->pages, s - slots, s->page_cnt * PGSIZE);
+        }
+      else 
+        {
+          check_fill (s, s - slots);
+          start = rdtsc ();
+          palloc_free_multiple (s->pages, s->page_cnt);
+          free_cycles += rdtsc () - start;
+          free_cnt++;
+          s->pages = NULL;
+        }
+    }
+
+  for (i = 0; i < SLOT_CNT; i++)
+    if (slots[i].pages != NULL) 
+      {
+        check_fill (&slots[i], i);
+        palloc_free_multiple (slots[i].pages, slots[i].page_cnt);
+      }
+
+  msg ("allocate: %llu cycles average", alloc_cycles / alloc_cnt);
+  msg ("free: %llu cycles average", free_cycles / free_cnt);
+
+  after = largest_block ();
+  if (after < before)
+    fail ("largest free block shrank from %zu to %zu pages",
+          before, after);
+  pass ();
+}
+
+/* Returns the number of pages in the largest power-of-2 block
+   that can currently be allocated from the kernel pool. */
+static size_t
+largest_block (void) 
+{
+  size_t page_cnt;
+
+  for (page_cnt = 1024; page_cnt > 0; page_cnt /= 2) 
+    {
+      void *pages = palloc_get_multiple (0, page_cnt);
+      if (pages != NULL) 
+        {
+          palloc_free_multiple (pages, page_cnt);
+          return page_cnt;
+        }
+    }
+  return 0;
+}
+
+/* Checks that every byte of the pages in S equals VALUE, which
+   fails if any two allocations overlapped. */
+static void
+check_fill (const struct slot *s, uint8_t value) 
+{
+  size_t i;
+
+  for (i = 0; i < s->page_cnt * PGSIZE; i++)
+    if (s->pages[i] != value)
+      fail ("%zu-page block at %p overwritten at offset %zu",
+            s->page_cnt, s->pages, i);
+}
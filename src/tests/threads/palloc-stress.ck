@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_benchmark ([<<'EOF']);
+(palloc-stress) begin
+(palloc-stress) allocate
+(palloc-stress) free
+(palloc-stress) PASS
+(palloc-stress) end
+EOF
+pass;
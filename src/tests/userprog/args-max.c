@@ -0,0 +1,52 @@
+/* Executes child-argv with the most arguments whose strings and
+   argv array fit in the 4 kB page at the top of the new
+   process's stack, then with one argument more, which must
+   fail. */
+
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Bytes the initial stack needs for ARGC arguments whose strings
+   take STR_SIZE bytes, including null terminators: the strings,
+   padded to a word boundary, argv[0] through argv[argc], then
+   argv, argc, and a return address. */
+static size_t
+stack_size (int argc, size_t str_size) 
+{
+  return ROUND_UP (str_size, 4) + (argc + 1) * 4 + 3 * 4;
+}
+
+static char cmd_line[4096];
+
+void
+test_main (void) 
+{
+  size_t len, str_size;
+  int argc;
+  char word[16];
+
+  strlcpy (cmd_line, "child-argv", sizeof cmd_line);
+  len = strlen (cmd_line);
+  argc = 1;
+  str_size = len + 1;
+  for (;;)
+    {
+      size_t word_len = snprintf (word, sizeof word, "%d", argc);
+      if (stack_size (argc + 1, str_size + word_len + 1) > 4096)
+        break;
+      len += snprintf (cmd_line + len, sizeof cmd_line - len, " %s", word);
+      str_size += word_len + 1;
+      argc++;
+    }
+
+  msg ("exec with %d arguments", argc);
+  CHECK (wait (exec (cmd_line)) == 0, "wait for child-argv");
+
+  snprintf (cmd_line + len, sizeof cmd_line - len, " %d", argc);
+  CHECK (exec (cmd_line) == -1,
+         "exec with %d arguments (must fail)", argc + 1);
+}
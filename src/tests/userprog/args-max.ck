@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(args-max) begin
+(args-max) exec with 522 arguments
+(child-argv) argc = 522
+child-argv: exit(0)
+(args-max) wait for child-argv
+(args-max) exec with 523 arguments (must fail)
+(args-max) end
+args-max: exit(0)
+EOF
+pass;
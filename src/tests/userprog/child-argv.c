@@ -0,0 +1,36 @@
+/* Child process run by args-max and exec-bench.
+   Checks that argv[1] through argv[argc - 1] are the decimal
+   numbers 1 through argc - 1, that argv[argc] is a null
+   pointer, and that the arguments lie in the top page of the
+   stack, then prints argc. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/lib.h"
+
+/* Top of user virtual memory. */
+#define PHYS_BASE 0xc0000000
+
+int
+main (int argc, char *argv[]) 
+{
+  char expect[16];
+  int i;
+
+  test_name = "child-argv";
+
+  for (i = 0; i < argc; i++) 
+    {
+      if ((uintptr_t) argv[i] < PHYS_BASE - 4096)
+        fail ("argv[%d] at %p is not in the top page", i, argv[i]);
+      snprintf (expect, sizeof expect, "%d", i);
+      if (i > 0 && strcmp (argv[i], expect))
+        fail ("argv[%d] is '%s' instead of '%s'", i, argv[i], expect);
+    }
+  if (argv[argc] != NULL)
+    fail ("argv[%d] is not null", argc);
+
+  msg ("argc = %d", argc);
+  return 0;
+}
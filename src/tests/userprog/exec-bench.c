@@ -0,0 +1,39 @@
+/* Measures how long it takes to execute and wait for a child
+   process with 1, 64, and 522 (the most that fit) arguments, and
+   reports the average cycles per exec. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define EXEC_CNT 10
+
+static char cmd_line[4096];
+
+/* Times EXEC_CNT runs of child-argv with ARGC arguments. */
+static void
+measure (int argc) 
+{
+  size_t len = snprintf (cmd_line, sizeof cmd_line, "child-argv");
+  uint64_t start;
+  int i;
+
+  for (i = 1; i < argc; i++)
+    len += snprintf (cmd_line + len, sizeof cmd_line - len, " %d", i);
+
+  start = rdtsc ();
+  for (i = 0; i < EXEC_CNT; i++)
+    if (wait (exec (cmd_line)) != 0)
+      fail ("child-argv with %d arguments failed", argc);
+  msg ("%d args: %llu cycles", argc, (rdtsc () - start) / EXEC_CNT);
+}
+
+void
+test_main (void) 
+{
+  measure (1);
+  measure (64);
+  measure (522);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# Drop the children's output.
+@output = grep (!/^\(child-argv\) argc = \d+$|^child-argv: exit\(0\)$/,
+                @output);
+@output = drop_cycles (@output);
+
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(exec-bench) begin
+(exec-bench) 1 args
+(exec-bench) 64 args
+(exec-bench) 522 args
+(exec-bench) end
+EOF
+pass;
@@ -0,0 +1,27 @@
+/* Corrupts the ELF header of an executable, then repairs it,
+   executing it after each step.  The kernel caches the headers
+   of executables it has loaded, so this checks that a write to
+   an executable discards the cached headers. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char magic;
+  int fd;
+
+  CHECK ((fd = open ("child-simple")) > 1, "open \"child-simple\"");
+  CHECK (read (fd, &magic, 1) == 1, "read ELF magic");
+  seek (fd, 0);
+  CHECK (write (fd, "X", 1) == 1, "overwrite ELF magic");
+  msg ("exec(\"child-simple\"): %d", exec ("child-simple"));
+
+  seek (fd, 0);
+  CHECK (write (fd, &magic, 1) == 1, "restore ELF magic");
+  msg ("wait(exec()) = %d", wait (exec ("child-simple")));
+  msg ("wait(exec()) = %d", wait (exec ("child-simple")));
+  close (fd);
+}
@@ -0,0 +1,56 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF', <<'EOF', <<'EOF']);
+(exec-cache) begin
+(exec-cache) open "child-simple"
+(exec-cache) read ELF magic
+(exec-cache) overwrite ELF magic
+load: child-simple: error loading executable
+(exec-cache) exec("child-simple"): -1
+(exec-cache) restore ELF magic
+(child-simple) run
+child-simple: exit(81)
+(exec-cache) wait(exec()) = 81
+(child-simple) run
+child-simple: exit(81)
+(exec-cache) wait(exec()) = 81
+(exec-cache) end
+exec-cache: exit(0)
+EOF
+(exec-cache) begin
+(exec-cache) open "child-simple"
+(exec-cache) read ELF magic
+(exec-cache) overwrite ELF magic
+load: child-simple: error loading executable
+child-simple: exit(-1)
+(exec-cache) exec("child-simple"): -1
+(exec-cache) restore ELF magic
+(child-simple) run
+child-simple: exit(81)
+(exec-cache) wait(exec()) = 81
+(child-simple) run
+child-simple: exit(81)
+(exec-cache) wait(exec()) = 81
+(exec-cache) end
+exec-cache: exit(0)
+EOF
+(exec-cache) begin
+(exec-cache) open "child-simple"
+(exec-cache) read ELF magic
+(exec-cache) overwrite ELF magic
+load: child-simple: error loading executable
+(exec-cache) exec("child-simple"): -1
+child-simple: exit(-1)
+(exec-cache) restore ELF magic
+(child-simple) run
+child-simple: exit(81)
+(exec-cache) wait(exec()) = 81
+(child-simple) run
+child-simple: exit(81)
+(exec-cache) wait(exec()) = 81
+(exec-cache) end
+exec-cache: exit(0)
+EOF
+pass;
@@ -0,0 +1,35 @@
+/* Opens the same file many times, enough to outgrow the file
+   descriptor table embedded in the thread and then its first
+   page, checking that each open returns the lowest free file
+   descriptor, including after some are closed. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define OPEN_CNT 1200
+
+void
+test_main (void) 
+{
+  char buf;
+  int i, fd;
+
+  for (i = 0; i < OPEN_CNT; i++) 
+    {
+      fd = open ("sample.txt");
+      if (fd != i + 2)
+        fail ("open #%d returned %d instead of %d", i, fd, i + 2);
+    }
+  msg ("opened \"sample.txt\" %d times", OPEN_CNT);
+
+  close (5);
+  close (1000);
+  CHECK ((fd = open ("sample.txt")) == 5, "reopen lowest free fd");
+  CHECK ((fd = open ("sample.txt")) == 1000, "reopen next free fd");
+  CHECK (read (OPEN_CNT + 1, &buf, 1) == 1, "read last fd");
+
+  for (i = 2; i < OPEN_CNT + 2; i++)
+    close (i);
+  CHECK ((fd = open ("sample.txt")) == 2, "open after closing all");
+}
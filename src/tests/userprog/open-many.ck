@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(open-many) begin
+(open-many) opened "sample.txt" 1200 times
+(open-many) reopen lowest free fd
+(open-many) reopen next free fd
+(open-many) read last fd
+(open-many) open after closing all
+(open-many) end
+open-many: exit(0)
+EOF
+pass;
@@ -0,0 +1,48 @@
+/* Writes sample.txt backward, one 16-byte record at a time,
+   with pwrite(), reads it back with pread(), and checks that
+   neither call moves the file position. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define RECORD 16
+
+void
+test_main (void) 
+{
+  char buf[sizeof sample];
+  size_t size = sizeof sample - 1;
+  int handle;
+  int ofs;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  msg ("pwrite records in reverse");
+  for (ofs = (size - 1) / RECORD * RECORD; ofs >= 0; ofs -= RECORD)
+    {
+      int len = size - ofs < RECORD ? (int) size - ofs : RECORD;
+      if (pwrite (handle, sample + ofs, len, ofs) != len)
+        fail ("pwrite() at offset %d failed", ofs);
+    }
+  if (tell (handle) != 0)
+    fail ("pwrite() moved file position to %u", tell (handle));
+
+  msg ("pread records");
+  for (ofs = 0; ofs < (int) size; ofs += RECORD)
+    {
+      int len = size - ofs < RECORD ? (int) size - ofs : RECORD;
+      if (pread (handle, buf + ofs, RECORD, ofs) != len)
+        fail ("pread() at offset %d returned wrong size", ofs);
+    }
+  if (tell (handle) != 0)
+    fail ("pread() moved file position to %u", tell (handle));
+  if (memcmp (buf, sample, size))
+    fail ("pread() data differs from sample.txt");
+
+  close (handle);
+  check_file ("test.txt", sample, size);
+}
@@ -0,0 +1,52 @@
+/* Writes sample.txt to a new file with writev() in three pieces,
+   then reads it back with readv() into three differently sized
+   buffers and checks that the data came back in order. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char a[17], b[100], c[sizeof sample];
+  struct iovec iov[3];
+  size_t size = sizeof sample - 1;
+  int handle, byte_cnt;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  iov[0].iov_base = (char *) sample;
+  iov[0].iov_len = 10;
+  iov[1].iov_base = (char *) sample + 10;
+  iov[1].iov_len = 200;
+  iov[2].iov_base = (char *) sample + 210;
+  iov[2].iov_len = size - 210;
+  byte_cnt = writev (handle, iov, 3);
+  if (byte_cnt != (int) size)
+    fail ("writev() returned %d instead of %zu", byte_cnt, size);
+  msg ("writev \"test.txt\"");
+
+  seek (handle, 0);
+  iov[0].iov_base = a;
+  iov[0].iov_len = sizeof a;
+  iov[1].iov_base = b;
+  iov[1].iov_len = sizeof b;
+  iov[2].iov_base = c;
+  iov[2].iov_len = sizeof c;
+  byte_cnt = readv (handle, iov, 3);
+  if (byte_cnt != (int) size)
+    fail ("readv() returned %d instead of %zu", byte_cnt, size);
+  if (memcmp (a, sample, sizeof a)
+      || memcmp (b, sample + sizeof a, sizeof b)
+      || memcmp (c, sample + sizeof a + sizeof b,
+                 size - sizeof a - sizeof b))
+    fail ("readv() data differs from sample.txt");
+  msg ("readv \"test.txt\"");
+
+  close (handle);
+  check_file ("test.txt", sample, size);
+}
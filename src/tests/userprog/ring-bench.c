@@ -0,0 +1,63 @@
+/* Writes a file in small records, first with one write() system
+   call per record and then through a submission ring, one
+   ring_enter() per batch of RING_SQ_ENTRIES records, and
+   reports the cycles each method takes per record. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define RECORD 16
+#define RECORD_CNT 1024
+
+static char record[RECORD];
+static struct ring ring __attribute__ ((aligned (4096)));
+
+void
+test_main (void) 
+{
+  uint64_t start;
+  int handle, i;
+
+  CHECK (ring_setup (&ring), "ring_setup");
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+
+  start = rdtsc ();
+  for (i = 0; i < RECORD_CNT; i++)
+    if (write (handle, record, RECORD) != RECORD)
+      fail ("write() of record %d failed", i);
+  msg ("write: %llu cycles", (rdtsc () - start) / RECORD_CNT);
+
+  seek (handle, 0);
+  start = rdtsc ();
+  for (i = 0; i < RECORD_CNT; i += RING_SQ_ENTRIES)
+    {
+      int j;
+
+      for (j = 0; j < RING_SQ_ENTRIES; j++)
+        {
+          struct ring_sqe *sqe = &ring.sq[ring.sq_tail % RING_SQ_ENTRIES];
+          sqe->opcode = RING_WRITE;
+          sqe->fd = handle;
+          sqe->buf = record;
+          sqe->len = RECORD;
+          sqe->ofs = -1;
+          sqe->user_data = i + j;
+          ring.sq_tail++;
+        }
+      if (ring_enter (RING_SQ_ENTRIES) != RING_SQ_ENTRIES)
+        fail ("ring_enter() of records %d... failed", i);
+      for (j = 0; j < RING_SQ_ENTRIES; j++)
+        {
+          struct ring_cqe *cqe = &ring.cq[ring.cq_head % RING_CQ_ENTRIES];
+          if (cqe->result != RECORD)
+            fail ("ring write of record %u failed", cqe->user_data);
+          ring.cq_head++;
+        }
+    }
+  msg ("ring: %llu cycles", (rdtsc () - start) / RECORD_CNT);
+
+  close (handle);
+}
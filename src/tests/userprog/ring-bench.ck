@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_benchmark (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(ring-bench) begin
+(ring-bench) ring_setup
+(ring-bench) create "data"
+(ring-bench) open "data"
+(ring-bench) write
+(ring-bench) ring
+(ring-bench) end
+EOF
+pass;
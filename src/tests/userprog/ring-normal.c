@@ -0,0 +1,81 @@
+/* Registers a submission ring, queues a batch of writes, a
+   no-op, and an operation on a bad file descriptor, submits
+   them with a single ring_enter(), and checks the completions.
+   Then reads the data back through the ring. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define RECORD 16
+
+static struct ring ring __attribute__ ((aligned (4096)));
+
+/* Queues an operation on RING with USER_DATA set to its
+   position in the submission order. */
+static void
+submit (int opcode, int fd, void *buf, unsigned len, int ofs)
+{
+  struct ring_sqe *sqe = &ring.sq[ring.sq_tail % RING_SQ_ENTRIES];
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->buf = buf;
+  sqe->len = len;
+  sqe->ofs = ofs;
+  sqe->user_data = ring.sq_tail;
+  ring.sq_tail++;
+}
+
+/* Reaps the next completion and checks that it belongs to
+   submission USER_DATA and returned RESULT. */
+static void
+reap (unsigned user_data, int result)
+{
+  struct ring_cqe *cqe;
+
+  if (ring.cq_head == ring.cq_tail)
+    fail ("completion %u missing", user_data);
+  cqe = &ring.cq[ring.cq_head % RING_CQ_ENTRIES];
+  if (cqe->user_data != user_data || cqe->result != result)
+    fail ("completion %u returned %d, expected completion %u with %d",
+          cqe->user_data, cqe->result, user_data, result);
+  ring.cq_head++;
+}
+
+void
+test_main (void) 
+{
+  char buf[3 * RECORD];
+  int handle, i;
+
+  CHECK (ring_setup (&ring), "ring_setup");
+  CHECK (!ring_setup (&ring), "ring_setup again (must fail)");
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  /* Write three records in reverse order, at explicit offsets. */
+  for (i = 2; i >= 0; i--)
+    submit (RING_WRITE, handle, (char *) sample + i * RECORD, RECORD,
+            i * RECORD);
+  submit (RING_NOP, 0, NULL, 0, 0);
+  submit (RING_READ, 123, buf, sizeof buf, -1);
+  CHECK (ring_enter (5) == 5, "submit 5 operations");
+  for (i = 0; i < 3; i++)
+    reap (i, RECORD);
+  reap (3, 0);
+  reap (4, -1);
+  msg ("reaped 5 completions");
+
+  /* Read them back at the file position. */
+  submit (RING_READ, handle, buf, sizeof buf, -1);
+  CHECK (ring_enter (1) == 1, "submit read");
+  reap (5, sizeof buf);
+  if (memcmp (buf, sample, sizeof buf))
+    fail ("data read through ring differs from data written");
+  CHECK (tell (handle) == sizeof buf, "file position advanced");
+
+  close (handle);
+  check_file ("test.txt", sample, sizeof buf);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-normal) begin
+(ring-normal) ring_setup
+(ring-normal) ring_setup again (must fail)
+(ring-normal) create "test.txt"
+(ring-normal) open "test.txt"
+(ring-normal) submit 5 operations
+(ring-normal) reaped 5 completions
+(ring-normal) submit read
+(ring-normal) file position advanced
+(ring-normal) open "test.txt" for verification
+(ring-normal) verified contents of "test.txt"
+(ring-normal) close "test.txt"
+(ring-normal) end
+ring-normal: exit(0)
+EOF
+pass;
@@ -0,0 +1,71 @@
+/* Measures null system call latency through both kernel entry
+   paths: the "int $0x30" interrupt gate and SYSENTER/SYSEXIT.
+   The call is ring_enter(0) without a registered ring, which the
+   kernel rejects right away, so nearly all of the time is spent
+   entering and leaving the kernel.  SYSENTER is skipped on a CPU
+   that lacks it. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CALL_CNT 10000
+
+/* Makes the null call with "int $0x30". */
+static int
+null_int30 (void)
+{
+  int retval;
+  asm volatile ("pushl $0; pushl %[number]; int $0x30; addl $8, %%esp"
+                : "=a" (retval) : [number] "i" (SYS_RING_ENTER) : "memory");
+  return retval;
+}
+
+/* Makes the null call with SYSENTER. */
+static int
+null_sysenter (void)
+{
+  int retval;
+  asm volatile ("pushl $0; pushl %[number]; "
+                "movl %%esp, %%ecx; movl $1f, %%edx; sysenter; 1: "
+                "addl $8, %%esp"
+                : "=a" (retval) : [number] "i" (SYS_RING_ENTER)
+                : "ecx", "edx", "memory");
+  return retval;
+}
+
+/* Times CALL_CNT calls to CALL and reports the average, in
+   cycles, under NAME. */
+static void
+measure (const char *name, int (*call) (void))
+{
+  uint64_t start = rdtsc ();
+  int i;
+
+  for (i = 0; i < CALL_CNT; i++)
+    if (call () != -1)
+      fail ("%s: null call returned wrong value", name);
+  msg ("%s: %llu cycles", name, (rdtsc () - start) / CALL_CNT);
+}
+
+/* Returns true if the CPU supports SYSENTER, as reported by bit
+   11 (SEP) of CPUID function 1's EDX. */
+static bool
+has_sysenter (void) 
+{
+  unsigned a, b, c, d;
+  asm ("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (1));
+  return (d & (1u << 11)) != 0;
+}
+
+void
+test_main (void) 
+{
+  measure ("int $0x30", null_int30);
+  if (has_sysenter ())
+    measure ("sysenter", null_sysenter);
+  else
+    msg ("sysenter: not supported");
+}
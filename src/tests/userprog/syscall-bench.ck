@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_benchmark (IGNORE_EXIT_CODES => 1, [<<'EOF', <<'EOF']);
+(syscall-bench) begin
+(syscall-bench) int $0x30
+(syscall-bench) sysenter
+(syscall-bench) end
+EOF
+(syscall-bench) begin
+(syscall-bench) int $0x30
+(syscall-bench) sysenter: not supported
+(syscall-bench) end
+EOF
+pass;
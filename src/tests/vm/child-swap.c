@@ -0,0 +1,44 @@
+/* Child process of page-swap.
+   Fills a 256 kB buffer with a pattern that depends on its
+   argument, then checks it several times over.  Run with less
+   user memory than the buffer needs, so that its pages go out
+   to swap and come back in between passes. */
+
+#include <stdlib.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (256 * 1024)
+#define WORD_CNT (SIZE / sizeof (unsigned))
+#define PASSES 3
+
+static unsigned buf[WORD_CNT];
+
+/* Returns the value expected in word IDX of the buffer of the
+   child with the given SEED. */
+static unsigned
+pattern (unsigned seed, size_t idx) 
+{
+  return (idx ^ (seed << 24)) * 2654435761u;
+}
+
+int
+main (int argc, char *argv[])
+{
+  unsigned seed = argc > 1 ? atoi (argv[1]) : 0;
+  size_t i;
+  int pass;
+
+  test_name = "child-swap";
+
+  for (i = 0; i < WORD_CNT; i++)
+    buf[i] = pattern (seed, i);
+
+  for (pass = 0; pass < PASSES; pass++)
+    for (i = 0; i < WORD_CNT; i++)
+      if (buf[i] != pattern (seed, i))
+        fail ("pass %d: word %zu is %08x, should be %08x",
+              pass, i, buf[i], pattern (seed, i));
+
+  return 0x42;
+}
@@ -0,0 +1,28 @@
+/* Runs 2 child-swap processes at once, in a user pool too small
+   to hold both of their buffers, so that pages of each process
+   are evicted to swap and read back in while the other runs. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 2
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++) 
+    {
+      char cmd_line[32];
+      snprintf (cmd_line, sizeof cmd_line, "child-swap %d", i);
+      CHECK ((children[i] = exec (cmd_line)) != -1,
+             "exec \"%s\"", cmd_line);
+    }
+
+  for (i = 0; i < CHILD_CNT; i++) 
+    CHECK (wait (children[i]) == 0x42, "wait for child %d", i);
+}
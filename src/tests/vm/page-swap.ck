@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-swap) begin
+(page-swap) exec "child-swap 0"
+(page-swap) exec "child-swap 1"
+(page-swap) wait for child 0
+(page-swap) wait for child 1
+(page-swap) end
+EOF
+pass;
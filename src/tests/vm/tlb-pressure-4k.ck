@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_benchmark (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(tlb-pressure-4k) begin
+(tlb-pressure-4k) pass 0
+(tlb-pressure-4k) pass 1
+(tlb-pressure-4k) pass 2
+(tlb-pressure-4k) pass 3
+(tlb-pressure-4k) end
+EOF
+pass;
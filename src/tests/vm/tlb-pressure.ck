@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_benchmark (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(tlb-pressure) begin
+(tlb-pressure) pass 0
+(tlb-pressure) pass 1
+(tlb-pressure) pass 2
+(tlb-pressure) pass 3
+(tlb-pressure) end
+EOF
+pass;
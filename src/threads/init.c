@@ -19,6 +19,7 @@
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/memstats.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
@@ -26,8 +27,10 @@
 #include "userprog/process.h"
 #include "userprog/exception.h"
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "userprog/vmstats.h"
 #else
 #include "tests/threads/tests.h"
 #endif
@@ -36,11 +39,22 @@
 #include "devices/ide.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/journal.h"
+#endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/swap.h"
 #endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
+/* -pse: Use 4 MB pages, if the CPU supports them? */
+bool init_large_pages;
+
+#define CR4_PSE 0x00000010      /* Page Size Extensions in CR4. */
+#define CPUID_PSE 0x00000008    /* PSE support in CPUID leaf 1 EDX. */
+
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
@@ -59,6 +73,7 @@ static size_t user_page_limit = SIZE_MAX;
 
 static void bss_init (void);
 static void paging_init (void);
+static bool cpu_has_pse (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -96,6 +111,7 @@ main (void)
 
   /* Initialize memory system. */
   palloc_init (user_page_limit);
+  memstats_init ();
   malloc_init ();
   paging_init ();
 
@@ -113,12 +129,19 @@ main (void)
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+  process_init ();
+#endif
+#ifdef VM
+  frame_init ();
 #endif
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
   serial_init_queue ();
   timer_calibrate ();
+#ifdef USERPROG
+  pagedir_init ();
+#endif
 
 #ifdef FILESYS
   /* Initialize file system. */
@@ -127,6 +150,11 @@ main (void)
   filesys_init (format_filesys);
 #endif
 
+#ifdef VM
+  /* Initialize swap space. */
+  swap_init ();
+#endif
+
   printf ("Boot complete.\n");
   
   /* Run actions specified on kernel command line. */
@@ -161,6 +189,12 @@ paging_init (void)
   size_t page;
   extern char _start, _end_kernel_text;
 
+  if (init_large_pages && !cpu_has_pse ())
+    {
+      printf ("CPU does not support 4 MB pages, ignoring -pse.\n");
+      init_large_pages = false;
+    }
+
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
   for (page = 0; page < init_ram_pages; page++)
@@ -171,6 +205,18 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      /* Map whole 4 MB regions of RAM that hold no kernel text
+         with a single PDE, saving a page table and TLB
+         entries. */
+      if (init_large_pages && pte_idx == 0
+          && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true, false);
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -180,6 +226,15 @@ paging_init (void)
       pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
     }
 
+  /* Enable 4 MB pages.  See [IA32-v3a] 3.7.3 "Mixing 4-KByte
+     and 4-MByte Pages". */
+  if (init_large_pages)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
+    }
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
@@ -188,6 +243,17 @@ paging_init (void)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
 }
 
+/* Returns true if the CPU supports 4 MB pages, as reported by
+   CPUID.  See [IA32-v2a] "CPUID". */
+static bool
+cpu_has_pse (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return (edx & CPUID_PSE) != 0;
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char **
@@ -247,6 +313,15 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-jcrash"))
+        {
+          if (value == NULL || !strcmp (value, "after"))
+            journal_crash = JOURNAL_CRASH_AFTER;
+          else if (!strcmp (value, "before"))
+            journal_crash = JOURNAL_CRASH_BEFORE;
+          else
+            PANIC ("unknown journal crash point \"%s\"", value);
+        }
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -256,9 +331,15 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-pse"))
+        init_large_pages = true;
+      else if (!strcmp (name, "-memstats"))
+        memstats_enabled = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-vmstats"))
+        vmstats_enabled = true;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -373,14 +454,19 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -jcrash[=WHEN]     Crash in the shutdown journal commit, WHEN\n"
+          "                     \"before\" or \"after\" (default) its commit point.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -pse               Use 4 MB pages where possible.\n"
+          "  -memstats          Print kernel memory statistics at shutdown.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -vmstats           Print VM statistics at process exit.\n"
 #endif
           );
   shutdown_power_off ();
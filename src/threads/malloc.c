@@ -5,17 +5,28 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
+#include "threads/memstats.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
 
-   The size of each request, in bytes, is rounded up to a power
-   of 2 and assigned to the "descriptor" that manages blocks of
-   that size.  The descriptor keeps a list of free blocks.  If
-   the free list is nonempty, one of its blocks is used to
-   satisfy the request.
+   The size of each request, in bytes, is rounded up to the
+   nearest size class and assigned to the "descriptor" that
+   manages blocks of that size.  Each class is the largest size
+   that fits a given number of blocks in an arena, so that no
+   arena space goes unused, and each is chosen to be at most 25%
+   bigger than the one before, rather than double, so that
+   rounding wastes no more than a fifth of a block.  Two ranges
+   cannot meet that bound: the smallest classes, which step by
+   the 8-byte minimum, and the largest, where an arena fits only
+   four, three, or two blocks, giving classes of 1016, 1360, and
+   2040 bytes.  The largest class still fits two blocks in an
+   arena.  The descriptor keeps a list of free blocks.  If the
+   free list is nonempty, one of its blocks is used to satisfy
+   the request.
 
    Otherwise, a new page of memory, called an "arena", is
    obtained from the page allocator (if none is available,
@@ -32,7 +43,33 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.  The
+   page allocator does not round page counts up, and it can
+   extend an allocation in place if the following pages are
+   free, which lets realloc() resize such blocks without
+   copying.
+
+   In front of each descriptor's free list sits a CPU cache of
+   two "magazines," small stacks of free blocks, after Bonwick
+   and Adams's "Magazines and Vmem."  Most calls to malloc() and
+   free() just pop or push a magazine, which needs no lock: on
+   our single CPU, disabling interrupts for a few instructions is
+   enough.  Only when both magazines are empty (or full) do we
+   take the descriptor's lock, and then we refill (or flush) a
+   whole magazine at once.  Blocks in a magazine count as in use
+   as far as their arenas are concerned, so when the page
+   allocator runs dry, malloc() drains every magazine, which may
+   free whole arenas, and tries once more. */
+
+/* Number of blocks a magazine holds. */
+#define MAG_ROUNDS 16
+
+/* Magazine: a stack of free blocks. */
+struct magazine
+  {
+    size_t cnt;                         /* Number of blocks. */
+    struct block *rounds[MAG_ROUNDS];   /* Blocks. */
+  };
 
 /* Descriptor. */
 struct desc
@@ -40,7 +77,13 @@ struct desc
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
+    size_t arena_cnt;           /* Number of arenas. */
     struct lock lock;           /* Lock. */
+
+    /* CPU cache.
+       Protected by disabling interrupts, not by LOCK. */
+    struct magazine loaded;     /* Magazine in use. */
+    struct magazine previous;   /* Full or empty spare magazine. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -61,26 +104,83 @@ struct block
   };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[32];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Block sizes are multiples of this many bytes. */
+#define SIZE_STEP 8
+
+/* Bytes in an arena available for blocks. */
+#define ARENA_SPACE (PGSIZE - sizeof (struct arena))
+
+/* Largest block size handled by a descriptor: half an arena. */
+#define MAX_BLOCK_SIZE (ARENA_SPACE / 2 / SIZE_STEP * SIZE_STEP)
+
+/* Maps a request size, divided by SIZE_STEP and rounded up, to
+   the index in descs[] of the smallest descriptor that can
+   satisfy it. */
+static uint8_t size_to_desc[MAX_BLOCK_SIZE / SIZE_STEP + 1];
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct block *mag_alloc (struct desc *);
+static bool mag_free (struct desc *, struct block *);
+static void free_to_desc (struct desc *, struct block *);
+static bool drain_magazines (void);
+static struct desc *size_desc (size_t size);
+static bool resize_in_place (void *, size_t new_size);
+static void *alloc_block (size_t size);
+
+/* Returns the largest multiple of SIZE_STEP that fits as many
+   blocks in an arena as blocks of SIZE bytes do.  The result is
+   at least SIZE if SIZE is a multiple of SIZE_STEP. */
+static size_t
+stretch (size_t size) 
+{
+  return ARENA_SPACE / (ARENA_SPACE / size) / SIZE_STEP * SIZE_STEP;
+}
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) 
 {
-  size_t block_size;
+  size_t block_size, size, i;
 
-  for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
+  block_size = stretch (16);
+  for (;;)
     {
       struct desc *d = &descs[desc_cnt++];
       ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
       d->block_size = block_size;
-      d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+      d->blocks_per_arena = ARENA_SPACE / block_size;
       list_init (&d->free_list);
+      d->arena_cnt = 0;
       lock_init (&d->lock);
+      d->loaded.cnt = d->previous.cnt = 0;
+
+      /* The next class is the biggest stretched size that is at
+         most 25% bigger than this one, or if there is none, the
+         smallest one that is bigger at all. */
+      if (d->block_size >= MAX_BLOCK_SIZE)
+        break;
+      block_size = 0;
+      for (size = d->block_size + SIZE_STEP; size <= MAX_BLOCK_SIZE;
+           size += SIZE_STEP)
+        {
+          size_t stretched = stretch (size);
+          if (block_size != 0 && stretched > d->block_size * 5 / 4)
+            break;
+          block_size = stretched;
+        }
+    }
+
+  /* Build the size lookup table. */
+  for (i = 0; i < sizeof size_to_desc; i++)
+    {
+      size_t d = 0;
+      while (d + 1 < desc_cnt && descs[d].block_size < i * SIZE_STEP)
+        d++;
+      size_to_desc[i] = d;
     }
 }
 
@@ -88,10 +188,21 @@ malloc_init (void)
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) 
+{
+  void *p = alloc_block (size);
+  memstats_alloc (p, size, memstats_caller (), false);
+  return p;
+}
+
+/* Implements malloc(). */
+static void *
+alloc_block (size_t size) 
 {
   struct desc *d;
   struct block *b;
   struct arena *a;
+  enum intr_level old_level;
+  bool drained = false;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -99,15 +210,15 @@ malloc (size_t size)
 
   /* Find the smallest descriptor that satisfies a SIZE-byte
      request. */
-  for (d = descs; d < descs + desc_cnt; d++)
-    if (d->block_size >= size)
-      break;
-  if (d == descs + desc_cnt) 
+  d = size_desc (size);
+  if (d == NULL) 
     {
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
       size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-      a = palloc_get_multiple (0, page_cnt);
+      a = palloc_get_multiple (PAL_UNTRACKED, page_cnt);
+      if (a == NULL && drain_magazines ())
+        a = palloc_get_multiple (PAL_UNTRACKED, page_cnt);
       if (a == NULL)
         return NULL;
 
@@ -119,25 +230,39 @@ malloc (size_t size)
       return a + 1;
     }
 
+  /* Try the CPU cache first. */
+  old_level = intr_disable ();
+  b = mag_alloc (d);
+  intr_set_level (old_level);
+  if (b != NULL)
+    return b;
+
   lock_acquire (&d->lock);
 
   /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  while (list_empty (&d->free_list))
     {
       size_t i;
 
-      /* Allocate a page. */
-      a = palloc_get_page (0);
+      /* Allocate a page.  If none is available, drain the
+         magazines, without holding our lock, and try again,
+         unless we already have. */
+      a = palloc_get_page (PAL_UNTRACKED);
       if (a == NULL) 
         {
           lock_release (&d->lock);
-          return NULL; 
+          if (drained || !drain_magazines ())
+            return NULL;
+          drained = true;
+          lock_acquire (&d->lock);
+          continue;
         }
 
       /* Initialize arena and add its blocks to the free list. */
       a->magic = ARENA_MAGIC;
       a->desc = d;
       a->free_cnt = d->blocks_per_arena;
+      d->arena_cnt++;
       for (i = 0; i < d->blocks_per_arena; i++) 
         {
           struct block *b = arena_to_block (a, i);
@@ -145,10 +270,23 @@ malloc (size_t size)
         }
     }
 
-  /* Get a block from free list and return it. */
+  /* Get a block from free list. */
   b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
   a = block_to_arena (b);
   a->free_cnt--;
+
+  /* Reload the CPU cache from what remains of the free list,
+     without creating any new arenas for it. */
+  old_level = intr_disable ();
+  while (d->loaded.cnt < MAG_ROUNDS && !list_empty (&d->free_list)) 
+    {
+      struct block *r = list_entry (list_pop_front (&d->free_list),
+                                    struct block, free_elem);
+      block_to_arena (r)->free_cnt--;
+      d->loaded.rounds[d->loaded.cnt++] = r;
+    }
+  intr_set_level (old_level);
+
   lock_release (&d->lock);
   return b;
 }
@@ -167,13 +305,30 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  p = alloc_block (size);
   if (p != NULL)
     memset (p, 0, size);
+  memstats_alloc (p, size, memstats_caller (), false);
 
   return p;
 }
 
+/* Returns the number of bytes that malloc() uses for a SIZE-byte
+   request, counting big blocks' arena headers and the unused
+   ends of their last pages. */
+size_t
+malloc_block_size (size_t size) 
+{
+  struct desc *d;
+
+  if (size == 0)
+    return 0;
+  d = size_desc (size);
+  if (d != NULL)
+    return d->block_size;
+  return ROUND_UP (size + sizeof (struct arena), PGSIZE);
+}
+
 /* Returns the number of bytes allocated for BLOCK. */
 static size_t
 block_size (void *block) 
@@ -199,9 +354,15 @@ realloc (void *old_block, size_t new_size)
       free (old_block);
       return NULL;
     }
+  else if (old_block != NULL && resize_in_place (old_block, new_size))
+    {
+      memstats_resize (old_block, new_size);
+      return old_block;
+    }
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block = alloc_block (new_size);
+      memstats_alloc (new_block, new_size, memstats_caller (), false);
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
@@ -213,6 +374,35 @@ realloc (void *old_block, size_t new_size)
     }
 }
 
+/* Tries to resize BLOCK to NEW_SIZE bytes without moving it.
+   Returns true if successful, false otherwise. */
+static bool
+resize_in_place (void *block, size_t new_size) 
+{
+  struct arena *a = block_to_arena (block);
+  size_t page_cnt;
+
+  /* A small block can stay put as long as it is the right size
+     class. */
+  if (a->desc != NULL)
+    return size_desc (new_size) == a->desc;
+
+  /* A big block stays big unless NEW_SIZE fits a descriptor. */
+  if (size_desc (new_size) != NULL)
+    return false;
+
+  /* Give back trailing pages that are no longer needed, or
+     claim the pages that follow the block if they are free. */
+  page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+  if (page_cnt <= a->free_cnt)
+    palloc_free_multiple ((uint8_t *) a + page_cnt * PGSIZE,
+                          a->free_cnt - page_cnt);
+  else if (!palloc_grow (a, a->free_cnt, page_cnt))
+    return false;
+  a->free_cnt = page_cnt;
+  return true;
+}
+
 /* Frees block P, which must have been previously allocated with
    malloc(), calloc(), or realloc(). */
 void
@@ -223,34 +413,51 @@ free (void *p)
       struct block *b = p;
       struct arena *a = block_to_arena (b);
       struct desc *d = a->desc;
-      
+
+      memstats_free (p);
+
       if (d != NULL) 
         {
           /* It's a normal block.  We handle it here. */
 
+          struct block *flushed[MAG_ROUNDS];
+          size_t flush_cnt = 0;
+          enum intr_level old_level;
+          size_t i;
+
 #ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
 
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
+          /* Try the CPU cache first. */
+          old_level = intr_disable ();
+          if (mag_free (d, b)) 
+            {
+              intr_set_level (old_level);
+              return;
+            }
+          intr_set_level (old_level);
 
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          lock_acquire (&d->lock);
+
+          /* Both magazines are full.  Empty the loaded one and
+             put B into it.  (Another thread may have made room
+             while we waited for the lock, in which case there is
+             nothing to flush.) */
+          old_level = intr_disable ();
+          if (!mag_free (d, b)) 
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              flush_cnt = d->loaded.cnt;
+              memcpy (flushed, d->loaded.rounds, sizeof flushed);
+              d->loaded.cnt = 0;
+              d->loaded.rounds[d->loaded.cnt++] = b;
             }
+          intr_set_level (old_level);
+
+          /* Return the flushed blocks to the free list. */
+          for (i = 0; i < flush_cnt; i++)
+            free_to_desc (d, flushed[i]);
 
           lock_release (&d->lock);
         }
@@ -263,6 +470,52 @@ free (void *p)
     }
 }
 
+/* Prints, for each size class in use, its number of arenas and
+   the fraction of their space occupied by blocks in use.
+   Blocks in the CPU cache count as free. */
+void
+malloc_print_stats (void) 
+{
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++) 
+    {
+      struct desc *d = &descs[i];
+      size_t total, free_cnt;
+      enum intr_level old_level;
+
+      if (d->arena_cnt == 0)
+        continue;
+      if (!lock_try_acquire (&d->lock)) 
+        {
+          printf ("malloc %zu-byte blocks: busy\n", d->block_size);
+          continue;
+        }
+      old_level = intr_disable ();
+      total = d->arena_cnt * d->blocks_per_arena;
+      free_cnt = list_size (&d->free_list) + d->loaded.cnt + d->previous.cnt;
+      intr_set_level (old_level);
+      lock_release (&d->lock);
+
+      printf ("malloc %zu-byte blocks: %zu arenas, %zu of %zu blocks used "
+              "(%zu%% of arena space)\n",
+              d->block_size, d->arena_cnt, total - free_cnt, total,
+              (total - free_cnt) * d->block_size * 100
+              / (d->arena_cnt * PGSIZE));
+    }
+}
+
+/* Returns the smallest descriptor whose blocks can hold SIZE
+   bytes, or a null pointer if SIZE is too big for any
+   descriptor. */
+static struct desc *
+size_desc (size_t size) 
+{
+  if (size > descs[desc_cnt - 1].block_size)
+    return NULL;
+  return &descs[size_to_desc[DIV_ROUND_UP (size, SIZE_STEP)]];
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -292,3 +545,105 @@ arena_to_block (struct arena *a, size_t idx)
                            + sizeof *a
                            + idx * a->desc->block_size);
 }
+
+/* Takes a block from D's CPU cache and returns it, or returns a
+   null pointer if both magazines are empty.
+   Interrupts must be off. */
+static struct block *
+mag_alloc (struct desc *d) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (d->loaded.cnt == 0 && d->previous.cnt > 0) 
+    {
+      struct magazine tmp = d->loaded;
+      d->loaded = d->previous;
+      d->previous = tmp;
+    }
+  return d->loaded.cnt > 0 ? d->loaded.rounds[--d->loaded.cnt] : NULL;
+}
+
+/* Puts B into D's CPU cache.  Returns true if successful, false
+   if both magazines are full.
+   Interrupts must be off. */
+static bool
+mag_free (struct desc *d, struct block *b) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (d->loaded.cnt == MAG_ROUNDS && d->previous.cnt < MAG_ROUNDS) 
+    {
+      struct magazine tmp = d->loaded;
+      d->loaded = d->previous;
+      d->previous = tmp;
+    }
+  if (d->loaded.cnt == MAG_ROUNDS)
+    return false;
+  d->loaded.rounds[d->loaded.cnt++] = b;
+  return true;
+}
+
+/* Returns the blocks in every descriptor's CPU cache to its free
+   list, freeing any arenas that leaves entirely unused.  Returns
+   true if any blocks were returned, false if the magazines were
+   all empty.  No descriptor's lock may be held. */
+static bool
+drain_magazines (void) 
+{
+  bool drained = false;
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++) 
+    {
+      struct desc *d = &descs[i];
+      struct block *flushed[2 * MAG_ROUNDS];
+      size_t flush_cnt = 0;
+      enum intr_level old_level;
+      size_t j;
+
+      lock_acquire (&d->lock);
+      old_level = intr_disable ();
+      while (d->loaded.cnt > 0)
+        flushed[flush_cnt++] = d->loaded.rounds[--d->loaded.cnt];
+      while (d->previous.cnt > 0)
+        flushed[flush_cnt++] = d->previous.rounds[--d->previous.cnt];
+      intr_set_level (old_level);
+
+      for (j = 0; j < flush_cnt; j++)
+        free_to_desc (d, flushed[j]);
+      lock_release (&d->lock);
+
+      if (flush_cnt > 0)
+        drained = true;
+    }
+  return drained;
+}
+
+/* Adds B to D's free list, freeing its arena if that leaves the
+   arena entirely unused.
+   D's lock must be held. */
+static void
+free_to_desc (struct desc *d, struct block *b) 
+{
+  struct arena *a = block_to_arena (b);
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* Add block to free list. */
+  list_push_front (&d->free_list, &b->free_elem);
+
+  /* If the arena is now entirely unused, free it. */
+  if (++a->free_cnt >= d->blocks_per_arena) 
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_remove (&b->free_elem);
+        }
+      palloc_free_page (a);
+      d->arena_cnt--;
+    }
+}
@@ -0,0 +1,255 @@
+#include "threads/memstats.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Kernel memory statistics.
+
+   With "-memstats" on the kernel command line, shutdown prints
+   the page usage and fragmentation of each page pool and of each
+   malloc() size class.
+
+   In a kernel built with MEMSTATS defined, every live block from
+   malloc() and every live run of pages from the page allocator
+   is also recorded in a side table along with its size and the
+   return address of the function that allocated it.  Shutdown
+   then also prints the allocation sites holding the most live
+   bytes, which usually points straight at a leak.  Feed the
+   addresses to "backtrace" to get source lines.  malloc()
+   obtains its own pages with PAL_UNTRACKED, so that the memory
+   behind a block is counted once, under the caller of malloc(),
+   rather than again under malloc() itself.
+
+   The side table is an open-addressed hash table keyed by
+   address, obtained from the page allocator at boot.  Pages are
+   freed with interrupts off in thread_schedule_tail(), so the
+   table is protected by disabling interrupts. */
+
+bool memstats_enabled;
+
+#ifdef MEMSTATS
+/* Number of entries in the side table.  Must be a power of 2. */
+#define TABLE_CNT 4096
+
+/* Number of pages occupied by the side table. */
+#define TABLE_PAGES ((TABLE_CNT * sizeof (struct alloc) + PGSIZE - 1) / PGSIZE)
+
+/* Number of allocation sites printed. */
+#define TOP_SITES 10
+
+/* Maximum number of distinct sites tallied when printing. */
+#define MAX_SITES 64
+
+/* A live allocation. */
+struct alloc
+  {
+    void *ptr;                  /* Address, or null if entry unused. */
+    void *caller;               /* Return address of allocator call. */
+    size_t size : 31;           /* Size in bytes. */
+    bool pages : 1;             /* From the page allocator? */
+  };
+
+/* Live allocations from one call site. */
+struct site
+  {
+    void *caller;               /* Return address of allocator call. */
+    bool pages;                 /* From the page allocator? */
+    size_t bytes;               /* Live bytes. */
+    size_t cnt;                 /* Live allocations. */
+  };
+
+static struct alloc *table;     /* Side table. */
+static size_t untracked_cnt;    /* Allocations dropped: table full. */
+
+static struct alloc *lookup (void *ptr);
+static void print_sites (void);
+#endif
+
+/* Sets up allocation tracking, if it is compiled in.  Must be
+   called after palloc_init() and before any allocations that
+   should be tracked. */
+void
+memstats_init (void) 
+{
+#ifdef MEMSTATS
+  table = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, TABLE_PAGES);
+#endif
+}
+
+/* Prints memory statistics, if "-memstats" was given. */
+void
+memstats_print (void) 
+{
+  if (!memstats_enabled)
+    return;
+
+  palloc_print_stats ();
+  malloc_print_stats ();
+#ifdef MEMSTATS
+  print_sites ();
+#else
+  printf ("Memstats: rebuild with MEMSTATS=1 for allocation sites.\n");
+#endif
+}
+
+#ifdef MEMSTATS
+/* Returns the hash table bucket for PTR. */
+static size_t
+bucket (void *ptr) 
+{
+  return ((uintptr_t) ptr >> 4) * 2654435761u % TABLE_CNT;
+}
+
+/* Records that CALLER allocated SIZE bytes at PTR, from the page
+   allocator if PAGES is true, otherwise from malloc(). */
+void
+memstats_alloc (void *ptr, size_t size, void *caller, bool pages) 
+{
+  enum intr_level old_level;
+  size_t i, probes;
+
+  if (ptr == NULL || table == NULL)
+    return;
+
+  old_level = intr_disable ();
+  for (i = bucket (ptr), probes = 0; probes < TABLE_CNT;
+       i = (i + 1) % TABLE_CNT, probes++)
+    if (table[i].ptr == NULL) 
+      {
+        table[i].ptr = ptr;
+        table[i].caller = caller;
+        table[i].size = size;
+        table[i].pages = pages;
+        break;
+      }
+  if (probes >= TABLE_CNT)
+    untracked_cnt++;
+  intr_set_level (old_level);
+}
+
+/* Records that the allocation at PTR is now SIZE bytes long. */
+void
+memstats_resize (void *ptr, size_t size) 
+{
+  enum intr_level old_level = intr_disable ();
+  struct alloc *a = lookup (ptr);
+  if (a != NULL)
+    a->size = size;
+  intr_set_level (old_level);
+}
+
+/* Records that the allocation at PTR was freed. */
+void
+memstats_free (void *ptr) 
+{
+  enum intr_level old_level;
+  struct alloc *a;
+  size_t i, j;
+
+  if (ptr == NULL || table == NULL)
+    return;
+
+  old_level = intr_disable ();
+  a = lookup (ptr);
+  if (a != NULL) 
+    {
+      /* Delete by shifting later entries in the same probe
+         sequence back into the hole, so that lookups can stop
+         at the first empty entry. */
+      i = a - table;
+      for (j = (i + 1) % TABLE_CNT; table[j].ptr != NULL;
+           j = (j + 1) % TABLE_CNT)
+        {
+          size_t k = bucket (table[j].ptr);
+          bool movable = (i <= j ? (k <= i || k > j) : (k <= i && k > j));
+          if (movable) 
+            {
+              table[i] = table[j];
+              i = j;
+            }
+        }
+      table[i].ptr = NULL;
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns the side table entry for PTR, or a null pointer if
+   there is none.
+   Interrupts must be off. */
+static struct alloc *
+lookup (void *ptr) 
+{
+  size_t i, probes;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (table == NULL)
+    return NULL;
+  for (i = bucket (ptr), probes = 0; probes < TABLE_CNT && table[i].ptr != NULL;
+       i = (i + 1) % TABLE_CNT, probes++)
+    if (table[i].ptr == ptr)
+      return &table[i];
+  return NULL;
+}
+
+/* Prints the allocation sites with the most live bytes. */
+static void
+print_sites (void) 
+{
+  static struct site sites[MAX_SITES];
+  size_t site_cnt = 0, other_bytes = 0;
+  enum intr_level old_level;
+  size_t i, j;
+
+  /* Tally live allocations by site. */
+  old_level = intr_disable ();
+  for (i = 0; i < TABLE_CNT; i++) 
+    {
+      struct alloc *a = &table[i];
+      if (a->ptr == NULL)
+        continue;
+
+      for (j = 0; j < site_cnt; j++)
+        if (sites[j].caller == a->caller && sites[j].pages == a->pages)
+          break;
+      if (j == site_cnt) 
+        {
+          if (site_cnt >= MAX_SITES) 
+            {
+              other_bytes += a->size;
+              continue;
+            }
+          sites[site_cnt].caller = a->caller;
+          sites[site_cnt].pages = a->pages;
+          sites[site_cnt].bytes = sites[site_cnt].cnt = 0;
+          site_cnt++;
+        }
+      sites[j].bytes += a->size;
+      sites[j].cnt++;
+    }
+  intr_set_level (old_level);
+
+  /* Sort by live bytes, most first. */
+  for (i = 0; i < site_cnt; i++)
+    for (j = i + 1; j < site_cnt; j++)
+      if (sites[j].bytes > sites[i].bytes) 
+        {
+          struct site tmp = sites[i];
+          sites[i] = sites[j];
+          sites[j] = tmp;
+        }
+
+  printf ("Memstats: top allocation sites by live bytes:\n");
+  for (i = 0; i < site_cnt && i < TOP_SITES; i++)
+    printf ("  %p: %zu bytes in %zu %s\n", sites[i].caller, sites[i].bytes,
+            sites[i].cnt, sites[i].pages ? "page runs" : "blocks");
+  if (other_bytes > 0)
+    printf ("  (other sites): %zu bytes\n", other_bytes);
+  if (untracked_cnt > 0)
+    printf ("  (untracked, table full): %zu allocations\n", untracked_cnt);
+}
+#endif /* MEMSTATS */
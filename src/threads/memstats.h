@@ -0,0 +1,30 @@
+#ifndef THREADS_MEMSTATS_H
+#define THREADS_MEMSTATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* If true, print kernel memory statistics at shutdown.
+   Controlled by kernel command-line option "-memstats". */
+extern bool memstats_enabled;
+
+void memstats_init (void);
+void memstats_print (void);
+
+/* Allocation tracking, compiled in only when the kernel is built
+   with MEMSTATS defined (e.g. "make MEMSTATS=1"). */
+#ifdef MEMSTATS
+void memstats_alloc (void *, size_t size, void *caller, bool pages);
+void memstats_resize (void *, size_t size);
+void memstats_free (void *);
+#else
+#define memstats_alloc(PTR, SIZE, CALLER, PAGES) ((void) 0)
+#define memstats_resize(PTR, SIZE) ((void) 0)
+#define memstats_free(PTR) ((void) 0)
+#endif
+
+/* Returns the address that the current function will return to,
+   for attributing an allocation to its caller. */
+#define memstats_caller() __builtin_return_address (0)
+
+#endif /* threads/memstats.h */
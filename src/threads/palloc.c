@@ -1,14 +1,15 @@
 #include "threads/palloc.h"
-#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
+#include "threads/memstats.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,14 +24,64 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed as a binary buddy system.  A block of
+   order K is 2**K pages long and starts at a physical page
+   number that is a multiple of 2**K, so the block's "buddy",
+   the other half of the order K+1 block that contains it, is
+   found by flipping bit K of its page number.  Free blocks are
+   kept on one list per order.  Allocation splits a larger free
+   block at most MAX_ORDER times, and freeing merges a block with
+   its free buddy at most MAX_ORDER times.  A request that is not
+   a power of 2 pages long is satisfied from a block of the next
+   larger order whose unused tail is freed again immediately, so
+   no memory is wasted to rounding.
+
+   Pages are freed from thread_schedule_tail(), where blocking is
+   not allowed, so the pools are protected by disabling
+   interrupts rather than by locks.  No buddy operation takes
+   more than O(MAX_ORDER) steps, so interrupts are never off for
+   long.
+
+   Each pool also keeps a small cache of free pages that the idle
+   thread has already filled with zeros, so that single-page
+   PAL_ZERO requests need not zero memory on the spot.  Cached
+   pages count as allocated.  They are handed back to the buddy
+   system whenever an allocation would otherwise fail. */
+
+/* Largest block order: 2**10 pages, or 4 MB. */
+#define MAX_ORDER 10
+
+/* Number of block orders. */
+#define ORDER_CNT (MAX_ORDER + 1)
+
+/* Page state bytes.
+   The state of the first page of a free block is PAGE_FREE
+   combined with the block's order.  The state of every other
+   page, allocated or not, is 0. */
+#define PAGE_FREE 0x80
+
+/* Maximum number of pre-zeroed pages cached per pool. */
+#define ZERO_CACHE_PAGES 32
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    uint8_t *state;                     /* One state byte per page. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages in pool. */
+    uintptr_t base_pfn;                 /* Physical page number of base. */
+    struct list free[ORDER_CNT];        /* Free blocks, by order. */
+    void *zeroed[ZERO_CACHE_PAGES];     /* Zeroed, allocated pages. */
+    size_t zeroed_cnt;                  /* Number of pages in zeroed. */
+  };
+
+/* A free block.
+   Stored in the first bytes of the block itself. */
+struct free_block
+  {
+    struct list_elem elem;              /* Element in pool's free list. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +90,17 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static void *alloc_pages (struct pool *, size_t page_cnt, unsigned order);
+static void free_pages (struct pool *, size_t page_idx, size_t page_cnt);
+static void *get_pages (enum palloc_flags, size_t page_cnt, size_t align);
+static void print_pool_stats (struct pool *, const char *name);
+static unsigned order_for (size_t page_cnt);
+static size_t free_block_containing (struct pool *, size_t page_idx,
+                                     unsigned *order);
+static void claim_page (struct pool *, size_t page_idx);
+static void *take_zeroed_page (struct pool *);
+static bool flush_zeroed_pages (struct pool *);
+static bool zero_page_for_pool (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -69,22 +131,77 @@ palloc_init (size_t user_page_limit)
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+{
+  void *pages = get_pages (flags, page_cnt, 1);
+  if (!(flags & PAL_UNTRACKED))
+    memstats_alloc (pages, PGSIZE * page_cnt, memstats_caller (), true);
+  return pages;
+}
+
+/* Obtains and returns a group of PAGE_CNT contiguous free pages
+   whose physical address is a multiple of ALIGN pages, which
+   must be a power of 2.  Otherwise behaves like
+   palloc_get_multiple(). */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt, size_t align)
+{
+  void *pages = get_pages (flags, page_cnt, align);
+  if (!(flags & PAL_UNTRACKED))
+    memstats_alloc (pages, PGSIZE * page_cnt, memstats_caller (), true);
+  return pages;
+}
+
+/* Obtains a single free page and returns its kernel virtual
+   address.
+   If PAL_USER is set, the page is obtained from the user pool,
+   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+   then the page is filled with zeros.  If no pages are
+   available, returns a null pointer, unless PAL_ASSERT is set in
+   FLAGS, in which case the kernel panics. */
+void *
+palloc_get_page (enum palloc_flags flags) 
+{
+  void *page = get_pages (flags, 1, 1);
+  if (!(flags & PAL_UNTRACKED))
+    memstats_alloc (page, PGSIZE, memstats_caller (), true);
+  return page;
+}
+
+/* Implements palloc_get_aligned(). */
+static void *
+get_pages (enum palloc_flags flags, size_t page_cnt, size_t align)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-  void *pages;
-  size_t page_idx;
+  enum intr_level old_level;
+  void *pages = NULL;
+  unsigned order;
 
+  ASSERT (align != 0 && (align & (align - 1)) == 0);
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  /* The zeroed cache holds single pages of any alignment. */
+  if ((flags & PAL_ZERO) && page_cnt == 1 && align == 1)
+    {
+      pages = take_zeroed_page (pool);
+      if (pages != NULL)
+        return pages;
+    }
 
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
+  /* Every block is aligned on its own size, so an aligned
+     request just needs a block at least as big as ALIGN. */
+  order = order_for (page_cnt);
+  if (order < order_for (align))
+    order = order_for (align);
+
+  if (order <= MAX_ORDER) 
+    {
+      old_level = intr_disable ();
+      pages = alloc_pages (pool, page_cnt, order);
+      if (pages == NULL && flush_zeroed_pages (pool))
+        pages = alloc_pages (pool, page_cnt, order);
+      intr_set_level (old_level);
+    }
 
   if (pages != NULL) 
     {
@@ -100,30 +217,20 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   return pages;
 }
 
-/* Obtains a single free page and returns its kernel virtual
-   address.
-   If PAL_USER is set, the page is obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
-   then the page is filled with zeros.  If no pages are
-   available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
-void *
-palloc_get_page (enum palloc_flags flags) 
-{
-  return palloc_get_multiple (flags, 1);
-}
-
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
     return;
 
+  memstats_free (pages);
+
   if (page_from_pool (&kernel_pool, pages))
     pool = &kernel_pool;
   else if (page_from_pool (&user_pool, pages))
@@ -132,13 +239,16 @@ palloc_free_multiple (void *pages, size_t page_cnt)
     NOT_REACHED ();
 
   page_idx = pg_no (pages) - pg_no (pool->base);
+  ASSERT (page_idx + page_cnt <= pool->page_cnt);
+  ASSERT (pool->state[page_idx] == 0);
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  old_level = intr_disable ();
+  free_pages (pool, page_idx, page_cnt);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +258,167 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Frees the PAGE_CNT single pages whose addresses are in
+   PAGES[].  The pages may come from either pool, in any order.
+   Equivalent to calling palloc_free_page() on each one, but
+   disables interrupts only once for the whole batch. */
+void
+palloc_free_batch (void *pages[], size_t page_cnt) 
+{
+  enum intr_level old_level;
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      ASSERT (pages[i] != NULL);
+      ASSERT (pg_ofs (pages[i]) == 0);
+      memstats_free (pages[i]);
+#ifndef NDEBUG
+      memset (pages[i], 0xcc, PGSIZE);
+#endif
+    }
+
+  old_level = intr_disable ();
+  for (i = 0; i < page_cnt; i++)
+    {
+      struct pool *pool;
+      size_t page_idx;
+
+      if (page_from_pool (&kernel_pool, pages[i]))
+        pool = &kernel_pool;
+      else if (page_from_pool (&user_pool, pages[i]))
+        pool = &user_pool;
+      else
+        NOT_REACHED ();
+
+      page_idx = pg_no (pages[i]) - pg_no (pool->base);
+      ASSERT (pool->state[page_idx] == 0);
+      free_pages (pool, page_idx, 1);
+    }
+  intr_set_level (old_level);
+}
+
+/* Tries to extend the PAGE_CNT pages starting at PAGES, which
+   must have been obtained from the page allocator, to NEW_CNT
+   pages by allocating the pages that immediately follow them.
+   Returns true if successful.  Returns false, changing nothing,
+   if any of those pages is in use or outside the pool. */
+bool
+palloc_grow (void *pages, size_t page_cnt, size_t new_cnt) 
+{
+  struct pool *pool;
+  enum intr_level old_level;
+  size_t page_idx, i;
+  bool success = true;
+
+  ASSERT (pg_ofs (pages) == 0);
+  ASSERT (new_cnt >= page_cnt);
+
+  if (page_from_pool (&kernel_pool, pages))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, pages))
+    pool = &user_pool;
+  else
+    NOT_REACHED ();
+
+  page_idx = pg_no (pages) - pg_no (pool->base);
+  if (page_idx + new_cnt > pool->page_cnt)
+    return false;
+
+  old_level = intr_disable ();
+  for (i = page_idx + page_cnt; i < page_idx + new_cnt; i++)
+    if (free_block_containing (pool, i, NULL) == SIZE_MAX) 
+      {
+        success = false;
+        break;
+      }
+  if (success)
+    for (i = page_idx + page_cnt; i < page_idx + new_cnt; i++)
+      claim_page (pool, i);
+  intr_set_level (old_level);
+
+  if (success)
+    memstats_resize (pages, PGSIZE * new_cnt);
+  return success;
+}
+
+/* Prints page usage and fragmentation for each pool. */
+void
+palloc_print_stats (void) 
+{
+  print_pool_stats (&kernel_pool, "Kernel pool");
+  print_pool_stats (&user_pool, "User pool");
+}
+
+/* Called by the idle thread when it has nothing else to do.
+   Zeros one free page and adds it to its pool's cache of
+   pre-zeroed pages, if any cache has room.  Returns true if a
+   page was zeroed, false if there was nothing to do.
+
+   Never blocks. */
+bool
+palloc_zero_idle (void)
+{
+  return zero_page_for_pool (&kernel_pool) || zero_page_for_pool (&user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  /* We'll put the pool's page state bytes at its base.
+     Calculate the space needed for them and subtract it from
+     the pool's size. */
+  size_t state_pages = DIV_ROUND_UP (page_cnt, PGSIZE);
+  unsigned order;
+  if (state_pages > page_cnt)
+    PANIC ("Not enough memory in %s for page state.", name);
+  page_cnt -= state_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  p->state = base;
+  p->base = base + state_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  p->base_pfn = vtop (p->base) >> PGBITS;
+  for (order = 0; order < ORDER_CNT; order++)
+    list_init (&p->free[order]);
+  p->zeroed_cnt = 0;
+
+  /* Free all the pages. */
+  memset (p->state, 0, page_cnt);
+  free_pages (p, 0, page_cnt);
+}
+
+/* Prints page usage and fragmentation for POOL, calling it
+   NAME.  Fragmentation is the fraction of free pages that lie
+   outside the largest free block. */
+static void
+print_pool_stats (struct pool *pool, const char *name) 
+{
+  size_t free_cnt = 0, block_cnt = 0, largest = 0, zeroed_cnt;
+  enum intr_level old_level;
+  unsigned order;
+
+  old_level = intr_disable ();
+  for (order = 0; order < ORDER_CNT; order++)
+    {
+      size_t n = list_size (&pool->free[order]);
+      free_cnt += n << order;
+      block_cnt += n;
+      if (n > 0)
+        largest = (size_t) 1 << order;
+    }
+  zeroed_cnt = pool->zeroed_cnt;
+  intr_set_level (old_level);
+
+  printf ("%s: %zu pages, %zu used, %zu free in %zu blocks "
+          "(largest %zu), %zu pre-zeroed, %zu%% fragmented\n",
+          name, pool->page_cnt, pool->page_cnt - free_cnt - zeroed_cnt,
+          free_cnt, block_cnt, largest, zeroed_cnt,
+          free_cnt > 0 ? 100 - largest * 100 / free_cnt : 0);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +428,238 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the smallest order whose blocks hold PAGE_CNT pages. */
+static unsigned
+order_for (size_t page_cnt) 
+{
+  unsigned order = 0;
+
+  while (((size_t) 1 << order) < page_cnt)
+    order++;
+  return order;
+}
+
+/* Returns the free block that starts at PAGE_IDX in POOL. */
+static struct free_block *
+block_at (struct pool *pool, size_t page_idx) 
+{
+  return (struct free_block *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Adds the free block of the given ORDER that starts at
+   PAGE_IDX to POOL's free lists, without trying to merge it. */
+static void
+push_block (struct pool *pool, size_t page_idx, unsigned order) 
+{
+  pool->state[page_idx] = PAGE_FREE | order;
+  list_push_front (&pool->free[order], &block_at (pool, page_idx)->elem);
+}
+
+/* Frees the block of the given ORDER that starts at PAGE_IDX in
+   POOL, merging it with its buddy for as long as the buddy is
+   also free. */
+static void
+free_block (struct pool *pool, size_t page_idx, unsigned order) 
+{
+  for (; order < MAX_ORDER; order++)
+    {
+      uintptr_t buddy_pfn = (pool->base_pfn + page_idx) ^ ((size_t) 1 << order);
+      size_t buddy_idx = buddy_pfn - pool->base_pfn;
+
+      if (buddy_pfn < pool->base_pfn
+          || buddy_idx + ((size_t) 1 << order) > pool->page_cnt
+          || pool->state[buddy_idx] != (PAGE_FREE | order))
+        break;
+
+      list_remove (&block_at (pool, buddy_idx)->elem);
+      pool->state[buddy_idx] = 0;
+      if (buddy_idx < page_idx)
+        page_idx = buddy_idx;
+    }
+  push_block (pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages that start at PAGE_IDX in POOL, which
+   need not form a single block, by breaking them into the
+   largest possible aligned blocks. */
+static void
+free_pages (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  while (page_cnt > 0)
+    {
+      uintptr_t pfn = pool->base_pfn + page_idx;
+      unsigned order = 0;
+
+      while (order < MAX_ORDER
+             && (pfn & ((size_t) 1 << order)) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Returns the index of the first page of the free block in POOL
+   that contains the page at PAGE_IDX, and stores the block's
+   order into *ORDER if ORDER is nonnull.  Returns SIZE_MAX if
+   that page is not free.
+   Interrupts must be off. */
+static size_t
+free_block_containing (struct pool *pool, size_t page_idx, unsigned *order) 
+{
+  uintptr_t pfn = pool->base_pfn + page_idx;
+  unsigned k;
+
+  for (k = 0; k < ORDER_CNT; k++)
+    {
+      uintptr_t head_pfn = pfn & ~(((uintptr_t) 1 << k) - 1);
+      size_t head_idx = head_pfn - pool->base_pfn;
+
+      if (head_pfn < pool->base_pfn)
+        break;
+      if (pool->state[head_idx] == (PAGE_FREE | k)) 
+        {
+          if (order != NULL)
+            *order = k;
+          return head_idx;
+        }
+    }
+  return SIZE_MAX;
+}
+
+/* Allocates the single free page at PAGE_IDX in POOL, splitting
+   the free block that contains it and freeing the rest.
+   Interrupts must be off. */
+static void
+claim_page (struct pool *pool, size_t page_idx) 
+{
+  unsigned order;
+  size_t head_idx = free_block_containing (pool, page_idx, &order);
+
+  ASSERT (head_idx != SIZE_MAX);
+
+  list_remove (&block_at (pool, head_idx)->elem);
+  pool->state[head_idx] = 0;
+  while (order > 0)
+    {
+      size_t half;
+
+      order--;
+      half = (size_t) 1 << order;
+      if (page_idx < head_idx + half)
+        push_block (pool, head_idx + half, order);
+      else 
+        {
+          push_block (pool, head_idx, order);
+          head_idx += half;
+        }
+    }
+  ASSERT (head_idx == page_idx);
+}
+
+/* Allocates PAGE_CNT pages from POOL out of a block of the given
+   ORDER, which must be big enough to hold them, and returns the
+   first page, or a null pointer if no block that large is free.
+   Interrupts must be off. */
+static void *
+alloc_pages (struct pool *pool, size_t page_cnt, unsigned order) 
+{
+  size_t block_size = (size_t) 1 << order;
+  unsigned k;
+
+  ASSERT (page_cnt <= block_size);
+
+  for (k = order; k < ORDER_CNT; k++)
+    if (!list_empty (&pool->free[k]))
+      {
+        struct free_block *b = list_entry (list_pop_front (&pool->free[k]),
+                                           struct free_block, elem);
+        size_t page_idx = ((uint8_t *) b - pool->base) / PGSIZE;
+
+        /* Split the block down to the requested order, freeing
+           the upper half each time. */
+        pool->state[page_idx] = 0;
+        while (k > order)
+          {
+            k--;
+            push_block (pool, page_idx + ((size_t) 1 << k), k);
+          }
+
+        /* Give back the pages past the end of the request. */
+        free_pages (pool, page_idx + page_cnt, block_size - page_cnt);
+
+        return pool->base + PGSIZE * page_idx;
+      }
+  return NULL;
+}
+
+/* Removes and returns a page from POOL's cache of pre-zeroed
+   pages, or a null pointer if the cache is empty. */
+static void *
+take_zeroed_page (struct pool *pool) 
+{
+  enum intr_level old_level;
+  void *page = NULL;
+
+  old_level = intr_disable ();
+  if (pool->zeroed_cnt > 0)
+    page = pool->zeroed[--pool->zeroed_cnt];
+  intr_set_level (old_level);
+
+  return page;
+}
+
+/* Frees all of the pages in POOL's cache of pre-zeroed pages.
+   Returns true if any pages were freed, false if the cache was
+   empty.
+   Interrupts must be off. */
+static bool
+flush_zeroed_pages (struct pool *pool) 
+{
+  bool flushed = pool->zeroed_cnt > 0;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (pool->zeroed_cnt > 0)
+    {
+      void *page = pool->zeroed[--pool->zeroed_cnt];
+      free_pages (pool, pg_no (page) - pg_no (pool->base), 1);
+    }
+  return flushed;
+}
+
+/* If POOL's cache of pre-zeroed pages has room, takes a free
+   page from POOL, zeros it, and adds it to the cache.
+   Returns true if successful, false if the cache is full or
+   POOL has no free pages. */
+static bool
+zero_page_for_pool (struct pool *pool) 
+{
+  enum intr_level old_level;
+  void *page;
+
+  /* Only the idle thread adds pages to the cache, so if there
+     is room now, there will still be room after zeroing. */
+  if (pool->zeroed_cnt >= ZERO_CACHE_PAGES)
+    return false;
+  old_level = intr_disable ();
+  page = alloc_pages (pool, 1, 0);
+  intr_set_level (old_level);
+  if (page == NULL)
+    return false;
+
+  memset (page, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  pool->zeroed[pool->zeroed_cnt++] = page;
+  intr_set_level (old_level);
+
+  return true;
+}
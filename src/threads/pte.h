@@ -66,6 +66,7 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page, 0=page table (PDEs only). */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -77,9 +78,31 @@ static inline uint32_t pde_create (uint32_t *pt) {
    PDE, which must "present", points to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
   ASSERT (pde & PTE_P);
+  ASSERT (!(pde & PTE_PS));
   return ptov (pde & PTE_ADDR);
 }
 
+/* Returns a PDE that maps the 4 MB page starting at PAGE, which
+   must be aligned on a 4 MB boundary, instead of pointing to a
+   page table.  Such PDEs are only understood by the CPU if
+   CR4.PSE is set.
+   If WRITABLE is true then the page will be writable.
+   If USER is true then the page will be usable by user code,
+   otherwise only by the kernel. */
+static inline uint32_t pde_create_large (void *page, bool writable,
+                                         bool user) {
+  ASSERT (((uintptr_t) page & (PTSPAN - 1)) == 0);
+  return (vtop (page) | PTE_P | PTE_PS
+          | (writable ? PTE_W : 0) | (user ? PTE_U : 0));
+}
+
+/* Returns a pointer to the 4 MB page that PDE, which must be
+   present and have PTE_PS set, maps. */
+static inline void *pde_get_large_page (uint32_t pde) {
+  ASSERT ((pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS));
+  return ptov (pde & PDMASK);
+}
+
 /* Returns a PTE that points to PAGE.
    The PTE's page is readable.
    If WRITABLE is true then it will be writable as well.
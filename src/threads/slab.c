@@ -0,0 +1,271 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+
+/* Slab allocator for kernel objects of a single type.
+
+   malloc() rounds every request up to one of its size classes,
+   so an object just over a class size wastes the rest of its
+   block, up to a fifth of it or, for the largest classes, a
+   third.  A kmem_cache instead carves single pages, called
+   "slabs," into blocks of exactly the object's size, after
+   Bonwick's "The Slab Allocator."
+
+   An optional constructor runs on each object when its slab is
+   created, and an optional destructor when its slab is returned
+   to the page allocator, not on every allocation and free.  An
+   object must therefore be freed in its constructed state, so
+   that expensive initialization is done once per slab rather
+   than once per use.
+
+   The first bytes of each slab hold a header and an array with
+   one free-list link per object.  Because free objects must keep
+   their constructed contents, the links cannot be stored in the
+   objects themselves.  Successive slabs start their objects at
+   different offsets, or "colors," using up the space left over
+   at the end of the page, so that the same object in different
+   slabs does not always map to the same CPU cache lines.
+
+   Each cache keeps at most one empty slab, returning others to
+   the page allocator. */
+
+/* Color offsets are multiples of this many bytes. */
+#define COLOR_ALIGN 32
+
+/* Marks the end of a slab's free list. */
+#define FREE_END UINT16_MAX
+
+/* Slab header, at the start of the slab's page. */
+struct slab
+  {
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in one of cache's lists. */
+    uint8_t *objs;              /* First object. */
+    size_t in_use;              /* Number of allocated objects. */
+    uint16_t free_idx;          /* Index of first free object. */
+    uint16_t next[];            /* Index of next free object. */
+  };
+
+/* All caches, for statistics. */
+static struct list all_caches = LIST_INITIALIZER (all_caches);
+
+static struct slab *slab_create (struct kmem_cache *);
+static void slab_destroy (struct kmem_cache *, struct slab *);
+
+/* Initializes CACHE to allocate SIZE-byte objects, naming it
+   NAME for statistics.  If CTOR is nonnull, it is called on each
+   object when the object's memory is first obtained; if DTOR is
+   nonnull, it is called on each object before its memory is
+   released. */
+void
+kmem_cache_init (struct kmem_cache *cache, const char *name, size_t size,
+                 kmem_obj_func *ctor, kmem_obj_func *dtor)
+{
+  size_t space;
+
+  ASSERT (size > 0);
+
+  cache->name = name;
+  cache->obj_size = size;
+  cache->size = ROUND_UP (size, sizeof (void *));
+  space = PGSIZE - sizeof (struct slab) - sizeof (void *);
+  cache->obj_cnt = space / (cache->size + sizeof (uint16_t));
+  if (cache->obj_cnt == 0 || cache->obj_cnt >= FREE_END)
+    PANIC ("%s: %zu-byte objects do not fit in a slab", name, size);
+  cache->color_max = space - cache->obj_cnt * (cache->size + sizeof (uint16_t));
+  cache->color_max -= cache->color_max % COLOR_ALIGN;
+  cache->next_color = 0;
+  cache->ctor = ctor;
+  cache->dtor = dtor;
+
+  lock_init (&cache->lock);
+  list_init (&cache->partial);
+  list_init (&cache->full);
+  list_init (&cache->empty);
+
+  cache->alloc_cnt = 0;
+  cache->alloc_cycles = 0;
+  cache->in_use = cache->peak_in_use = 0;
+  cache->slab_cnt = cache->peak_slab_cnt = 0;
+
+  list_push_back (&all_caches, &cache->elem);
+}
+
+/* Allocates and returns an object from CACHE, or a null pointer
+   if memory is not available.  If CACHE has a constructor, the
+   object is in its constructed state. */
+void *
+kmem_cache_alloc (struct kmem_cache *cache)
+{
+  uint64_t start = rdtsc ();
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&cache->lock);
+
+  /* Find a slab with a free object, creating one if necessary. */
+  if (!list_empty (&cache->partial))
+    s = list_entry (list_front (&cache->partial), struct slab, elem);
+  else if (!list_empty (&cache->empty))
+    {
+      s = list_entry (list_pop_front (&cache->empty), struct slab, elem);
+      list_push_front (&cache->partial, &s->elem);
+    }
+  else
+    {
+      s = slab_create (cache);
+      if (s == NULL)
+        {
+          lock_release (&cache->lock);
+          return NULL;
+        }
+      list_push_front (&cache->partial, &s->elem);
+    }
+
+  /* Take the slab's first free object. */
+  ASSERT (s->free_idx != FREE_END);
+  obj = s->objs + s->free_idx * cache->size;
+  s->free_idx = s->next[s->free_idx];
+  if (++s->in_use == cache->obj_cnt)
+    {
+      list_remove (&s->elem);
+      list_push_front (&cache->full, &s->elem);
+    }
+
+  if (++cache->in_use > cache->peak_in_use)
+    cache->peak_in_use = cache->in_use;
+  cache->alloc_cnt++;
+  cache->alloc_cycles += rdtsc () - start;
+
+  lock_release (&cache->lock);
+  return obj;
+}
+
+/* Returns OBJ, which must have been allocated from CACHE, to
+   CACHE.  If CACHE has a constructor, OBJ must be in its
+   constructed state. */
+void
+kmem_cache_free (struct kmem_cache *cache, void *obj)
+{
+  struct slab *s;
+  size_t idx;
+
+  if (obj == NULL)
+    return;
+
+  s = pg_round_down (obj);
+  ASSERT (s->cache == cache);
+  idx = ((uint8_t *) obj - s->objs) / cache->size;
+  ASSERT (s->objs + idx * cache->size == obj);
+
+  lock_acquire (&cache->lock);
+
+  s->next[idx] = s->free_idx;
+  s->free_idx = idx;
+  cache->in_use--;
+  if (s->in_use-- == cache->obj_cnt)
+    {
+      /* Slab was full, now partial. */
+      list_remove (&s->elem);
+      list_push_front (&cache->partial, &s->elem);
+    }
+  if (s->in_use == 0)
+    {
+      /* Slab is now empty.  Keep one empty slab around. */
+      list_remove (&s->elem);
+      if (list_empty (&cache->empty))
+        list_push_front (&cache->empty, &s->elem);
+      else
+        slab_destroy (cache, s);
+    }
+
+  lock_release (&cache->lock);
+}
+
+/* Prints statistics for every cache that has been used. */
+void
+kmem_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&all_caches); e != list_end (&all_caches);
+       e = list_next (e))
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+      size_t malloc_size;
+      size_t saved;
+
+      if (c->alloc_cnt == 0)
+        continue;
+
+      /* Bytes that malloc() would have used for the same peak
+         number of objects, less the slab pages actually used. */
+      malloc_size = malloc_block_size (c->obj_size);
+      saved = c->peak_in_use * malloc_size;
+      saved = saved > c->peak_slab_cnt * PGSIZE
+              ? saved - c->peak_slab_cnt * PGSIZE : 0;
+
+      printf ("Slab %s: %llu allocs (%llu cycles avg), "
+              "peak %zu objects in %zu slabs, %zu bytes saved\n",
+              c->name, c->alloc_cnt, c->alloc_cycles / c->alloc_cnt,
+              c->peak_in_use, c->peak_slab_cnt, saved);
+    }
+}
+
+/* Obtains a page for a new slab for CACHE, constructs its
+   objects, and returns it.  Returns a null pointer if no page is
+   available.  CACHE's lock must be held. */
+static struct slab *
+slab_create (struct kmem_cache *cache)
+{
+  struct slab *s;
+  size_t i;
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->cache = cache;
+  s->objs = (uint8_t *) &s->next[cache->obj_cnt];
+  s->objs = (uint8_t *) ROUND_UP ((uintptr_t) s->objs, sizeof (void *));
+  s->objs += cache->next_color;
+  cache->next_color += COLOR_ALIGN;
+  if (cache->next_color > cache->color_max)
+    cache->next_color = 0;
+  ASSERT (s->objs + cache->obj_cnt * cache->size <= (uint8_t *) s + PGSIZE);
+
+  s->in_use = 0;
+  s->free_idx = 0;
+  for (i = 0; i < cache->obj_cnt; i++)
+    {
+      s->next[i] = i + 1 < cache->obj_cnt ? i + 1 : FREE_END;
+      if (cache->ctor != NULL)
+        cache->ctor (s->objs + i * cache->size);
+    }
+
+  if (++cache->slab_cnt > cache->peak_slab_cnt)
+    cache->peak_slab_cnt = cache->slab_cnt;
+  return s;
+}
+
+/* Destroys the objects in slab S, which must be empty, and frees
+   its page.  CACHE's lock must be held. */
+static void
+slab_destroy (struct kmem_cache *cache, struct slab *s)
+{
+  size_t i;
+
+  ASSERT (s->in_use == 0);
+
+  if (cache->dtor != NULL)
+    for (i = 0; i < cache->obj_cnt; i++)
+      cache->dtor (s->objs + i * cache->size);
+  cache->slab_cnt--;
+  palloc_free_page (s);
+}
@@ -0,0 +1,45 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/synch.h"
+
+/* Constructor or destructor for objects in a slab cache. */
+typedef void kmem_obj_func (void *obj);
+
+/* A cache of equal-size objects. */
+struct kmem_cache
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t obj_size;            /* Size of an object, as requested. */
+    size_t size;                /* Size of an object, as laid out. */
+    size_t obj_cnt;             /* Objects per slab. */
+    size_t color_max;           /* Largest color offset. */
+    size_t next_color;          /* Color offset for the next slab. */
+    kmem_obj_func *ctor;        /* Constructor, or a null pointer. */
+    kmem_obj_func *dtor;        /* Destructor, or a null pointer. */
+    struct list_elem elem;      /* Element in list of all caches. */
+
+    struct lock lock;           /* Protects the members below. */
+    struct list partial;        /* Slabs with free and used objects. */
+    struct list full;           /* Slabs with no free objects. */
+    struct list empty;          /* Slabs with no used objects. */
+
+    /* Statistics. */
+    unsigned long long alloc_cnt;       /* Allocations. */
+    unsigned long long alloc_cycles;    /* CPU cycles spent allocating. */
+    size_t in_use;              /* Objects allocated now. */
+    size_t peak_in_use;         /* Most objects allocated at once. */
+    size_t slab_cnt;            /* Slabs now. */
+    size_t peak_slab_cnt;       /* Most slabs at once. */
+  };
+
+void kmem_cache_init (struct kmem_cache *, const char *name, size_t size,
+                      kmem_obj_func *ctor, kmem_obj_func *dtor);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_print_stats (void);
+
+#endif /* threads/slab.h */
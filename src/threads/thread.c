@@ -14,6 +14,12 @@
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#endif
+#ifdef FILESYS
+#include "filesys/filesys.h"
+#endif
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
@@ -134,6 +140,16 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+#ifdef VM
+  /* Count the running process's ticks for the working set
+     sampler. */
+  frame_tick ();
+#endif
+#ifdef FILESYS
+  /* Schedule background writes of file system metadata. */
+  filesys_tick ();
+#endif
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
@@ -394,6 +410,15 @@ idle (void *idle_started_ UNUSED)
 
   for (;;) 
     {
+      /* With nothing else to do, zero a free page for later
+         PAL_ZERO allocations, then give any thread that became
+         ready in the meantime a chance to run. */
+      if (palloc_zero_idle ())
+        {
+          thread_yield ();
+          continue;
+        }
+
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
@@ -462,6 +487,9 @@ init_thread (struct thread *t, const char *name, int priority)
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
+#ifdef USERPROG
+  t->exit_code = -1;
+#endif
   t->magic = THREAD_MAGIC;
 
   old_level = intr_disable ();
@@ -2,8 +2,13 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
+#include <stddef.h>
 #include <stdint.h>
+#ifdef USERPROG
+#include "userprog/vmstats.h"
+#endif
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -24,6 +29,10 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* File descriptor slots embedded in struct thread.  Must be less
+   than 32, so that they fit in one bitmap word. */
+#define FD_EMBED 16
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -96,6 +105,38 @@ struct thread
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    int exit_code;                      /* Exit code. */
+    struct file *bin_file;              /* Executable, denied writes. */
+    struct wait_status *wait_status;    /* This process's completion. */
+    struct hash children;               /* Children's wait_status. */
+    bool children_ready;                /* CHILDREN initialized? */
+
+    /* Owned by userprog/syscall.c. */
+    struct file **fds;                  /* Open files, indexed by fd. */
+    uint32_t *fd_used;                  /* Bitmap of FDS slots in use. */
+    int fd_cnt;                         /* Number of slots in FDS. */
+    int fd_scan;                        /* First FD_USED word to scan. */
+    struct file *fd_embed[FD_EMBED];    /* Initial FDS. */
+    uint32_t fd_embed_used;             /* Initial FD_USED. */
+    struct ring *ring;                  /* Registered ring, kernel view. */
+    void *ring_upage;                   /* Registered ring, user page. */
+
+    /* Owned by userprog/vmstats.c. */
+    struct vmstats vmstats;             /* Virtual memory statistics. */
+#endif
+
+#ifdef FILESYS
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of journal_begin(). */
+#endif
+
+#ifdef VM
+    /* Owned by vm/frame.c. */
+    size_t resident_cnt;                /* Number of frames held. */
+    size_t ws_size;                     /* Working set size estimate. */
+    unsigned ws_ticks;                  /* Ticks run since last sample. */
+    size_t ws_accessed;                 /* Frames accessed, in sample. */
+    bool ws_sampling;                   /* Being sampled? */
 #endif
 
     /* Owned by thread.c. */
@@ -2,13 +2,22 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
+#include "userprog/vmstats.h"
+#include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
 static void kill (struct intr_frame *);
+static void debug (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 
 /* Registers handlers for interrupts that can be caused by user
@@ -43,7 +52,7 @@ exception_init (void)
      caused indirectly, e.g. #DE can be caused by dividing by
      0.  */
   intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
-  intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
+  intr_register_int (1, 0, INTR_ON, debug, "#DB Debug Exception");
   intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
   intr_register_int (7, 0, INTR_ON, kill,
                      "#NM Device Not Available Exception");
@@ -108,6 +117,20 @@ kill (struct intr_frame *f)
     }
 }
 
+/* Debug exception handler.  SYSENTER does not clear the trap
+   flag, so a user program that executes SYSENTER while single-
+   stepping takes a debug trap in the kernel's entry stub.  We
+   just clear the flag and carry on.  Other debug exceptions are
+   handled like any other exception. */
+static void
+debug (struct intr_frame *f) 
+{
+  if (f->cs == SEL_KCSEG && (f->eflags & FLAG_TF))
+    f->eflags &= ~FLAG_TF;
+  else
+    kill (f);
+}
+
 /* Page fault handler.  This is a skeleton that must be filled in
    to implement virtual memory.  Some solutions to project 2 may
    also require modifying this code.
@@ -126,6 +149,7 @@ page_fault (struct intr_frame *f)
   bool write;        /* True: access was write, false: access was read. */
   bool user;         /* True: access by user, false: access by kernel. */
   void *fault_addr;  /* Fault address. */
+  uint64_t start;    /* Time stamp at entry, for statistics. */
 
   /* Obtain faulting address, the virtual address that was
      accessed to cause the fault.  It may point to code or to
@@ -135,6 +159,7 @@ page_fault (struct intr_frame *f)
      [IA32-v3a] 5.15 "Interrupt 14--Page Fault Exception
      (#PF)". */
   asm ("movl %%cr2, %0" : "=r" (fault_addr));
+  start = rdtsc ();
 
   /* Turn interrupts back on (they were only off so that we could
      be assured of reading CR2 before it changed). */
@@ -148,6 +173,41 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+  /* A write to a writable page that still shares the zero page
+     gets a private copy and is restarted.  This applies to
+     kernel writes to user memory, too. */
+  if (!not_present && write && is_user_vaddr (fault_addr)
+      && thread_current ()->pagedir != NULL
+      && pagedir_unshare_zero_page (thread_current ()->pagedir, fault_addr))
+    {
+      vmstats_fault (FAULT_COW, start);
+      return;
+    }
+
+#ifdef VM
+  /* An access to a page that was evicted brings it back in from
+     swap. */
+  if (not_present && is_user_vaddr (fault_addr)
+      && thread_current ()->pagedir != NULL
+      && frame_swap_in (pg_round_down (fault_addr)))
+    {
+      vmstats_fault (FAULT_SWAP_IN, start);
+      return;
+    }
+#endif
+
+  /* A kernel access to a user address comes from one of the
+     user memory primitives in userprog/syscall.c, which put the
+     address to resume at in EAX.  Resume there with EAX set to
+     -1 to report the fault. */
+  if (!user && is_user_vaddr (fault_addr))
+    {
+      f->eip = (void (*) (void)) f->eax;
+      f->eax = 0xffffffff;
+      vmstats_fault (FAULT_INVALID, start);
+      return;
+    }
+
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
@@ -156,6 +216,7 @@ page_fault (struct intr_frame *f)
           not_present ? "not present" : "rights violation",
           write ? "writing" : "reading",
           user ? "user" : "kernel");
+  vmstats_fault (FAULT_INVALID, start);
   kill (f);
 }
 
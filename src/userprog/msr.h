@@ -0,0 +1,30 @@
+#ifndef USERPROG_MSR_H
+#define USERPROG_MSR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Model-specific registers that configure SYSENTER.
+   See [IA32-v3a] section 4.8.7 "Fast System Calls". */
+#define MSR_SYSENTER_CS 0x174   /* Kernel code segment. */
+#define MSR_SYSENTER_ESP 0x175  /* Kernel stack pointer. */
+#define MSR_SYSENTER_EIP 0x176  /* Entry point. */
+
+/* Writes VALUE to model-specific register MSR. */
+static inline void
+wrmsr (uint32_t msr, uint32_t value)
+{
+  asm volatile ("wrmsr" : : "c" (msr), "a" (value), "d" (0));
+}
+
+/* Returns true if the CPU supports SYSENTER and SYSEXIT, as
+   reported by bit 11 (SEP) of CPUID function 1's EDX. */
+static inline bool
+cpu_has_sysenter (void)
+{
+  uint32_t a, b, c, d;
+  asm ("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (1));
+  return (d & (1u << 11)) != 0;
+}
+
+#endif /* userprog/msr.h */
@@ -5,10 +5,66 @@
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/swap.h"
+#endif
 
+/* PTE bit, taken from PTE_AVL, marking a read-only mapping of
+   zero_page that the process is nonetheless allowed to write.
+   The first write faults and gets a private copy. */
+#define PTE_ZERO 0x200
+
+/* PTE bit, taken from PTE_AVL, marking a not-present PTE whose
+   page was evicted to swap.  The swap slot is kept in the
+   PTE's address bits. */
+#define PTE_SWAP 0x400
+
+/* A page of zeros shared, read-only, by every user mapping of an
+   untouched zero-filled page.  Lives in the kernel's BSS, so it
+   is never handed to palloc_free_page(). */
+static uint8_t zero_page[PGSIZE] __attribute__ ((aligned (PGSIZE)));
+
+/* Maximum number of pages freed in one palloc_free_batch(). */
+#define FREE_BATCH 64
+
+/* Page directories queued by pagedir_reap(), waiting for the
+   reaper thread to free them.
+
+   Until the reaper gets to a directory, its pages are not free.
+   So that a process never fails for lack of memory that only
+   awaits the reaper, an allocation for a process that fails
+   calls pagedir_reclaim() to free the queue at once, then tries
+   again.  Out-of-memory tests such as multi-oom thus see the
+   same memory as if exiting processes freed their own. */
+#define REAP_MAX 16
+static uint32_t *reap_queue[REAP_MAX];
+static size_t reap_head, reap_cnt;
+static struct lock reap_lock;
+static struct condition reap_cond;
+static bool reaper_started;
+
+static thread_func reaper;
+#ifdef VM
+static void release_frames (uint32_t *);
+#endif
+static void free_pagedir (uint32_t *);
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
 
+/* Starts the reaper thread. */
+void
+pagedir_init (void) 
+{
+  lock_init (&reap_lock);
+  cond_init (&reap_cond);
+  if (thread_create ("reaper", PRI_DEFAULT, reaper, NULL) == TID_ERROR)
+    PANIC ("can't create page directory reaper");
+  reaper_started = true;
+}
+
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
    Returns the new page directory, or a null pointer if memory
@@ -16,34 +72,153 @@ static void invalidate_pagedir (uint32_t *);
 uint32_t *
 pagedir_create (void) 
 {
-  uint32_t *pd = palloc_get_page (0);
+  uint32_t *pd;
+
+  pd = palloc_get_page (0);
+  if (pd == NULL && pagedir_reclaim ())
+    pd = palloc_get_page (0);
   if (pd != NULL)
     memcpy (pd, init_page_dir, PGSIZE);
   return pd;
 }
 
 /* Destroys page directory PD, freeing all the pages it
-   references. */
+   references.  Leaves most of the work to the reaper thread, so
+   that an exiting process finishes sooner.  PD must not be
+   active. */
 void
-pagedir_destroy (uint32_t *pd) 
+pagedir_reap (uint32_t *pd) 
 {
-  uint32_t *pde;
+  bool queued = false;
 
   if (pd == NULL)
     return;
 
   ASSERT (pd != init_page_dir);
+#ifdef VM
+  /* The frame table refers to the owning thread, which is about
+     to go away, so this part cannot wait. */
+  release_frames (pd);
+#endif
+
+  lock_acquire (&reap_lock);
+  if (reaper_started && reap_cnt < REAP_MAX)
+    {
+      reap_queue[(reap_head + reap_cnt++) % REAP_MAX] = pd;
+      cond_signal (&reap_cond, &reap_lock);
+      queued = true;
+    }
+  lock_release (&reap_lock);
+
+  if (!queued)
+    free_pagedir (pd);
+}
+
+/* Frees all of the page directories waiting for the reaper.
+   Returns true if there were any, false if the queue was
+   empty. */
+bool
+pagedir_reclaim (void) 
+{
+  bool reclaimed = false;
+
+  for (;;)
+    {
+      uint32_t *pd = NULL;
+
+      lock_acquire (&reap_lock);
+      if (reap_cnt > 0)
+        {
+          pd = reap_queue[reap_head];
+          reap_head = (reap_head + 1) % REAP_MAX;
+          reap_cnt--;
+        }
+      lock_release (&reap_lock);
+
+      if (pd == NULL)
+        break;
+      free_pagedir (pd);
+      reclaimed = true;
+    }
+  return reclaimed;
+}
+
+/* Reaper thread.  Frees page directories queued by
+   pagedir_reap(). */
+static void
+reaper (void *aux UNUSED) 
+{
+  for (;;)
+    {
+      lock_acquire (&reap_lock);
+      while (reap_cnt == 0)
+        cond_wait (&reap_cond, &reap_lock);
+      lock_release (&reap_lock);
+
+      pagedir_reclaim ();
+    }
+}
+
+#ifdef VM
+/* Removes the pages that PD maps from the frame table and frees
+   its swap slots, leaving the pages themselves allocated. */
+static void
+release_frames (uint32_t *pd) 
+{
+  uint32_t *pde;
+
+  /* Keep the page replacement code from evicting our pages
+     while we tear them down. */
+  frame_table_acquire ();
+  for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
+    if ((*pde & PTE_P) && !(*pde & PTE_PS)) 
+      {
+        uint32_t *pt = pde_get_pt (*pde);
+        uint32_t *pte;
+        
+        for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
+          if ((*pte & PTE_P) && pte_get_page (*pte) != zero_page) 
+            frame_forget_locked (pte_get_page (*pte));
+          else if (*pte & PTE_SWAP)
+            {
+              swap_free (*pte >> PGBITS);
+              *pte = 0;
+            }
+      }
+  frame_table_release ();
+}
+#endif
+
+/* Frees PD, its page tables, and the pages they map, handing
+   pages to palloc_free_batch() FREE_BATCH at a time. */
+static void
+free_pagedir (uint32_t *pd) 
+{
+  void *batch[FREE_BATCH];
+  size_t batch_cnt = 0;
+  uint32_t *pde;
+
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
+    if (*pde & PTE_PS)
+      palloc_free_multiple (pde_get_large_page (*pde), PTSPAN / PGSIZE);
+    else if (*pde & PTE_P) 
       {
         uint32_t *pt = pde_get_pt (*pde);
         uint32_t *pte;
         
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
-          if (*pte & PTE_P) 
-            palloc_free_page (pte_get_page (*pte));
+          if ((*pte & PTE_P) && pte_get_page (*pte) != zero_page) 
+            {
+              batch[batch_cnt++] = pte_get_page (*pte);
+              if (batch_cnt == FREE_BATCH)
+                {
+                  palloc_free_batch (batch, batch_cnt);
+                  batch_cnt = 0;
+                }
+            }
         palloc_free_page (pt);
       }
+  palloc_free_batch (batch, batch_cnt);
   palloc_free_page (pd);
 }
 
@@ -52,7 +227,9 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.
+   If VADDR lies in a 4 MB page, there is no page table entry
+   for it, so a null pointer is returned regardless of CREATE. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -66,11 +243,15 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
   /* Check for a page table for VADDR.
      If one is missing, create one if requested. */
   pde = pd + pd_no (vaddr);
+  if (*pde & PTE_PS)
+    return NULL;
   if (*pde == 0) 
     {
       if (create)
         {
           pt = palloc_get_page (PAL_ZERO);
+          if (pt == NULL && pagedir_reclaim ())
+            pt = palloc_get_page (PAL_ZERO);
           if (pt == NULL) 
             return NULL; 
       
@@ -118,6 +299,95 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
     return false;
 }
 
+/* Adds a mapping in page directory PD from the 4 MB region of
+   user virtual memory starting at UPAGE to the 4 MB of physical
+   memory starting at kernel virtual address KPAGE, using a
+   single page directory entry.  Both addresses must be aligned
+   on a 4 MB boundary, and 4 MB pages must be enabled.
+   KPAGE should probably be obtained from the user pool with
+   palloc_get_aligned(); pagedir_reap() frees it.
+   If WRITABLE is true, the new pages are read/write; otherwise
+   they are read-only.
+   Returns true if successful, false if part of the region is
+   already mapped. */
+bool
+pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage,
+                        bool writable)
+{
+  uint32_t *pde;
+
+  ASSERT (init_large_pages);
+  ASSERT (((uintptr_t) upage & (PTSPAN - 1)) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (pd != init_page_dir);
+
+  pde = pd + pd_no (upage);
+  if (*pde != 0)
+    return false;
+  *pde = pde_create_large (kpage, writable, true);
+  return true;
+}
+
+/* Maps user virtual page UPAGE in page directory PD to the
+   shared zero page.  The mapping is read-only in hardware.  If
+   WRITABLE is true, the first write to UPAGE instead replaces
+   the mapping with a private, zeroed page; see
+   pagedir_unshare_zero_page().
+   UPAGE must not already be mapped.
+   Returns true if successful, false if memory allocation
+   failed. */
+bool
+pagedir_set_zero_page (uint32_t *pd, void *upage, bool writable)
+{
+  uint32_t *pte;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (pd != init_page_dir);
+
+  pte = lookup_page (pd, upage, true);
+
+  if (pte != NULL) 
+    {
+      ASSERT ((*pte & PTE_P) == 0);
+      *pte = pte_create_user (zero_page, false) | (writable ? PTE_ZERO : 0);
+      return true;
+    }
+  else
+    return false;
+}
+
+/* If user virtual address UADDR in PD lies in a writable mapping
+   of the shared zero page, replaces that mapping with a freshly
+   zeroed private page that is writable, and returns true.
+   Otherwise, or if no user page is available, returns false. */
+bool
+pagedir_unshare_zero_page (uint32_t *pd, const void *uaddr)
+{
+  uint32_t *pte;
+  void *kpage;
+
+  ASSERT (is_user_vaddr (uaddr));
+
+  pte = lookup_page (pd, uaddr, false);
+  if (pte == NULL || (*pte & (PTE_P | PTE_ZERO)) != (PTE_P | PTE_ZERO))
+    return false;
+
+#ifdef VM
+  kpage = frame_alloc (PAL_ZERO, pg_round_down (uaddr));
+#else
+  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (kpage == NULL && pagedir_reclaim ())
+    kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+#endif
+  if (kpage == NULL)
+    return false;
+
+  *pte = pte_create_user (kpage, true);
+  invalidate_pagedir (pd);
+  return true;
+}
+
 /* Looks up the physical address that corresponds to user virtual
    address UADDR in PD.  Returns the kernel virtual address
    corresponding to that physical address, or a null pointer if
@@ -128,6 +398,10 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
   uint32_t *pte;
 
   ASSERT (is_user_vaddr (uaddr));
+
+  if (pd[pd_no (uaddr)] & PTE_PS)
+    return ((uint8_t *) pde_get_large_page (pd[pd_no (uaddr)])
+            + ((uintptr_t) uaddr & (PTSPAN - 1)));
   
   pte = lookup_page (pd, uaddr, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
@@ -156,6 +430,48 @@ pagedir_clear_page (uint32_t *pd, void *upage)
     }
 }
 
+#ifdef VM
+/* Marks user virtual page UPAGE in PD, which must be mapped,
+   "not present" and records that its contents are in swap
+   SLOT.  Later accesses to the page will fault, and
+   pagedir_get_swapped() will find SLOT. */
+void
+pagedir_set_swapped (uint32_t *pd, void *upage, size_t slot)
+{
+  uint32_t *pte;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (slot < (1u << (32 - PGBITS)));
+
+  pte = lookup_page (pd, upage, false);
+  ASSERT (pte != NULL && (*pte & PTE_P) != 0);
+  *pte = (slot << PGBITS) | PTE_SWAP | (*pte & PTE_W);
+  invalidate_pagedir (pd);
+}
+
+/* If user virtual address UADDR in PD lies in a page that was
+   evicted to swap, stores its swap slot into *SLOT and whether
+   it is writable into *WRITABLE, and returns true.  Otherwise,
+   returns false. */
+bool
+pagedir_get_swapped (uint32_t *pd, const void *uaddr, size_t *slot,
+                     bool *writable)
+{
+  uint32_t *pte;
+
+  ASSERT (is_user_vaddr (uaddr));
+
+  pte = lookup_page (pd, uaddr, false);
+  if (pte == NULL || (*pte & (PTE_P | PTE_SWAP)) != PTE_SWAP)
+    return false;
+
+  *slot = *pte >> PGBITS;
+  *writable = (*pte & PTE_W) != 0;
+  return true;
+}
+#endif /* VM */
+
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
@@ -2,13 +2,25 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+void pagedir_init (void);
 uint32_t *pagedir_create (void);
-void pagedir_destroy (uint32_t *pd);
+void pagedir_reap (uint32_t *pd);
+bool pagedir_reclaim (void);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
+bool pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage,
+                             bool rw);
+bool pagedir_set_zero_page (uint32_t *pd, void *upage, bool rw);
+bool pagedir_unshare_zero_page (uint32_t *pd, const void *uaddr);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
 void pagedir_clear_page (uint32_t *pd, void *upage);
+#ifdef VM
+void pagedir_set_swapped (uint32_t *pd, void *upage, size_t slot);
+bool pagedir_get_swapped (uint32_t *pd, const void *uaddr, size_t *slot,
+                          bool *writable);
+#endif
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
@@ -7,62 +7,277 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "userprog/vmstats.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
+
+/* Data structure shared between process_execute() in the
+   invoking thread and start_process() in the newly invoked
+   thread. */
+struct exec_info 
+  {
+    const char *file_name;              /* Program to load (argv[0]). */
+    const void *args;                   /* Initial stack contents. */
+    size_t args_size;                   /* Size of ARGS in bytes. */
+    struct semaphore load_done;         /* "Up"ed when loading complete. */
+    struct wait_status *wait_status;    /* Child process. */
+    bool success;                       /* Program successfully loaded? */
+  };
+
+/* Tracks the completion of a process.
+   Shared between a parent process and one of its children, and
+   freed by whichever of them lets go of it last.  The parent
+   finds it in its CHILDREN hash table by the child's tid. */
+struct wait_status
+  {
+    struct hash_elem elem;              /* Element in parent's CHILDREN. */
+    struct lock lock;                   /* Protects REF_CNT. */
+    int ref_cnt;                        /* 2=child and parent both alive,
+                                           1=either child or parent alive,
+                                           0=child and parent both dead. */
+    tid_t tid;                          /* Child thread id. */
+    int exit_code;                      /* Child exit code, if dead. */
+    struct semaphore dead;              /* 1=child alive, 0=child dead. */
+  };
 
 static thread_func start_process NO_RETURN;
-static bool load (const char *cmdline, void (**eip) (void), void **esp);
+static bool build_args (const char *cmd_line, uint8_t *page,
+                        struct exec_info *);
+static bool load (const struct exec_info *, void (**eip) (void),
+                  void **esp);
+static bool init_children (struct thread *);
+static void release_child (struct wait_status *);
+
+/* Executables most recently loaded, held open so that their
+   cached headers survive from one run to the next even when no
+   process is running them in between, as when a shell runs the
+   same command repeatedly.  One that is removed is closed as
+   soon as the remove succeeds, and the rest at shutdown, so
+   that removed executables give back their blocks. */
+#define EXEC_KEEP 4
+static struct inode *kept_execs[EXEC_KEEP];
+static struct lock kept_execs_lock;
+
+static void drop_execs (bool all);
+
+/* Initializes the user process subsystem. */
+void
+process_init (void) 
+{
+  lock_init (&kept_execs_lock);
+}
+
+/* Shuts down the user process subsystem, closing the
+   executables kept open for reuse so that any that were removed
+   give back their blocks. */
+void
+process_done (void) 
+{
+  drop_execs (true);
+}
+
+/* Closes the kept executables that have been removed, so that
+   their blocks are freed.  Called after a file is removed. */
+void
+process_drop_removed (void) 
+{
+  drop_execs (false);
+}
 
-/* Starts a new thread running a user program loaded from
-   FILENAME.  The new thread may be scheduled (and may even exit)
-   before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
+/* Starts a new thread running a user program loaded from the
+   first word of command line CMD_LINE, with the words of
+   CMD_LINE as its arguments, and waits for it to finish loading.
+   Returns the new process's thread id, or TID_ERROR if the
+   thread cannot be created or the program cannot be loaded. */
 tid_t
-process_execute (const char *file_name) 
+process_execute (const char *cmd_line) 
 {
-  char *fn_copy;
-  tid_t tid;
+  struct thread *cur = thread_current ();
+  struct exec_info exec;
+  struct wait_status *ws;
+  uint8_t *page;
+  tid_t tid = TID_ERROR;
+
+  if (!init_children (cur))
+    return TID_ERROR;
 
-  /* Make a copy of FILE_NAME.
-     Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0);
-  if (fn_copy == NULL)
+  /* Parse CMD_LINE, just once, into the new process's initial
+     stack.  The page stays valid because we wait for load() to
+     finish with it. */
+  page = palloc_get_page (0);
+  if (page == NULL && pagedir_reclaim ())
+    page = palloc_get_page (0);
+  if (page == NULL)
     return TID_ERROR;
-  strlcpy (fn_copy, file_name, PGSIZE);
 
-  /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (file_name, PRI_DEFAULT, start_process, fn_copy);
-  if (tid == TID_ERROR)
-    palloc_free_page (fn_copy); 
+  /* Set up the record of the child's completion, with a
+     reference for each of parent and child. */
+  exec.wait_status = ws = malloc (sizeof *ws);
+  if (ws != NULL)
+    {
+      lock_init (&ws->lock);
+      ws->ref_cnt = 2;
+      ws->exit_code = -1;
+      sema_init (&ws->dead, 0);
+    }
+
+  if (ws != NULL && build_args (cmd_line, page, &exec))
+    {
+      /* Create a new thread to execute the program. */
+      sema_init (&exec.load_done, 0);
+      tid = thread_create (exec.file_name, PRI_DEFAULT, start_process,
+                           &exec);
+      if (tid == TID_ERROR && pagedir_reclaim ())
+        tid = thread_create (exec.file_name, PRI_DEFAULT, start_process,
+                             &exec);
+      if (tid != TID_ERROR)
+        {
+          sema_down (&exec.load_done);
+          if (exec.success) 
+            {
+              ws->tid = tid;
+              hash_insert (&cur->children, &ws->elem);
+            }
+          else 
+            {
+              /* The child is exiting, and no one will wait. */
+              release_child (ws);
+              tid = TID_ERROR;
+            }
+        }
+      else
+        free (ws);
+    }
+  else
+    free (ws);
+  palloc_free_page (page);
   return tid;
 }
 
+/* Returns the next space-delimited word in *S and stores its
+   length in *LEN, advancing *S past it.  Returns a null pointer
+   if *S has no more words. */
+static const char *
+next_word (const char **s, size_t *len) 
+{
+  const char *word = *s + strspn (*s, " ");
+  if (*word == '\0')
+    return NULL;
+  *len = strcspn (word, " ");
+  *s = word + *len;
+  return word;
+}
+
+/* Returns the user virtual address that byte P, in a page whose
+   end is TOP, will have once the page is copied to the top of
+   the user stack. */
+static void *
+stack_address (const uint8_t *top, const void *p) 
+{
+  return (uint8_t *) PHYS_BASE - (top - (const uint8_t *) p);
+}
+
+/* Splits CMD_LINE into words and builds, at the end of PAGE, the
+   initial stack for a process with those words as arguments,
+   laid out exactly as it will appear at the top of the user
+   stack, so that setup_stack() can install it with a single
+   copy.  From the top down:
+
+        argument strings, in order, each null-terminated
+        padding to a 4-byte boundary
+        argv[argc] (a null pointer), argv[argc - 1], ..., argv[0]
+        argv
+        argc
+        return address (0)     <-- initial stack pointer
+
+   Sets EXEC's FILE_NAME (to argv[0] within PAGE), ARGS, and
+   ARGS_SIZE.  Returns false if CMD_LINE has no words or the
+   stack would not fit in a page. */
+static bool
+build_args (const char *cmd_line, uint8_t *page, struct exec_info *exec) 
+{
+  uint8_t *top = page + PGSIZE;
+  size_t argc = 0, str_size = 0, size, i;
+  const char *s, *word;
+  size_t len;
+  uint8_t *strings;
+  char *str, **argv;
+  uint32_t *sp;
+
+  /* Measure. */
+  for (s = cmd_line; (word = next_word (&s, &len)) != NULL; ) 
+    {
+      argc++;
+      str_size += len + 1;
+    }
+  size = (ROUND_UP (str_size, sizeof (uint32_t))
+          + (argc + 1) * sizeof (char *) + 3 * sizeof (uint32_t));
+  if (argc == 0 || size > PGSIZE)
+    return false;
+
+  /* Build. */
+  strings = top - str_size;
+  argv = (char **) (top - ROUND_UP (str_size, sizeof (uint32_t))) - (argc + 1);
+  memset (argv + argc + 1, 0, strings - (uint8_t *) (argv + argc + 1));
+  str = (char *) strings;
+  for (s = cmd_line, i = 0; (word = next_word (&s, &len)) != NULL; i++) 
+    {
+      memcpy (str, word, len);
+      str[len] = '\0';
+      argv[i] = stack_address (top, str);
+      str += len + 1;
+    }
+  argv[argc] = NULL;
+
+  sp = (uint32_t *) argv;
+  *--sp = (uint32_t) stack_address (top, argv);
+  *--sp = argc;
+  *--sp = 0;
+
+  exec->file_name = (const char *) strings;
+  exec->args = sp;
+  exec->args_size = top - (uint8_t *) sp;
+  return true;
+}
+
 /* A thread function that loads a user process and starts it
    running. */
 static void
-start_process (void *file_name_)
+start_process (void *exec_)
 {
-  char *file_name = file_name_;
+  struct exec_info *exec = exec_;
   struct intr_frame if_;
   bool success;
 
+  thread_current ()->wait_status = exec->wait_status;
+
   /* Initialize interrupt frame and load executable. */
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (file_name, &if_.eip, &if_.esp);
+  success = load (exec, &if_.eip, &if_.esp);
 
-  /* If load failed, quit. */
-  palloc_free_page (file_name);
+  /* Notify parent thread.  EXEC lives on the parent's stack, so
+     we must not touch it after this. */
+  exec->success = success;
+  sema_up (&exec->load_done);
   if (!success) 
     thread_exit ();
 
@@ -81,14 +296,81 @@ start_process (void *file_name_)
    exception), returns -1.  If TID is invalid or if it was not a
    child of the calling process, or if process_wait() has already
    been successfully called for the given TID, returns -1
-   immediately, without waiting.
-
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+   immediately, without waiting. */
 int
-process_wait (tid_t child_tid UNUSED) 
+process_wait (tid_t child_tid) 
+{
+  struct thread *cur = thread_current ();
+  struct wait_status key, *ws;
+  struct hash_elem *e;
+  int exit_code;
+
+  if (!cur->children_ready)
+    return -1;
+  key.tid = child_tid;
+  e = hash_delete (&cur->children, &key.elem);
+  if (e == NULL)
+    return -1;
+
+  ws = hash_entry (e, struct wait_status, elem);
+  sema_down (&ws->dead);
+  exit_code = ws->exit_code;
+  release_child (ws);
+  return exit_code;
+}
+
+/* Returns a hash value for wait_status E. */
+static unsigned
+child_hash (const struct hash_elem *e, void *aux UNUSED) 
 {
-  return -1;
+  return hash_int (hash_entry (e, struct wait_status, elem)->tid);
+}
+
+/* Returns true if wait_status A precedes wait_status B. */
+static bool
+child_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED) 
+{
+  return (hash_entry (a, struct wait_status, elem)->tid
+          < hash_entry (b, struct wait_status, elem)->tid);
+}
+
+/* Initializes T's table of children, if it is not already
+   initialized.  This waits until T first creates a child,
+   rather than happening at thread creation, both because
+   init_thread() cannot allocate memory and because most
+   processes never create children.  Returns true if successful,
+   false if memory is exhausted. */
+static bool
+init_children (struct thread *t) 
+{
+  if (!t->children_ready)
+    t->children_ready = hash_init (&t->children, child_hash, child_less,
+                                   NULL);
+  return t->children_ready;
+}
+
+/* Drops a reference to WS, freeing it if that was the last. */
+static void
+release_child (struct wait_status *ws) 
+{
+  bool last;
+
+  lock_acquire (&ws->lock);
+  last = --ws->ref_cnt == 0;
+  lock_release (&ws->lock);
+  if (last)
+    free (ws);
+}
+
+/* Drops the current process's reference to the wait_status in
+   hash element E, as the process exits without waiting for the
+   child.  If the child has already exited, this frees the
+   record; otherwise the child frees it when it exits. */
+static void
+orphan_child (struct hash_elem *e, void *aux UNUSED) 
+{
+  release_child (hash_entry (e, struct wait_status, elem));
 }
 
 /* Free the current process's resources. */
@@ -98,11 +380,19 @@ process_exit (void)
   struct thread *cur = thread_current ();
   uint32_t *pd;
 
-  /* Destroy the current process's page directory and switch back
-     to the kernel-only page directory. */
+  /* Close executable (allowing writes again) and open files. */
+  file_close (cur->bin_file);
+  cur->bin_file = NULL;
+  syscall_exit ();
+
+  /* Switch back to the kernel-only page directory and hand the
+     current process's page directory to the reaper. */
   pd = cur->pagedir;
   if (pd != NULL) 
     {
+      printf ("%s: exit(%d)\n", cur->name, cur->exit_code);
+      vmstats_print ();
+
       /* Correct ordering here is crucial.  We must set
          cur->pagedir to NULL before switching page directories,
          so that a timer interrupt can't switch back to the
@@ -112,7 +402,18 @@ process_exit (void)
          that's been freed (and cleared). */
       cur->pagedir = NULL;
       pagedir_activate (NULL);
-      pagedir_destroy (pd);
+      pagedir_reap (pd);
+    }
+
+  /* Let go of our children, and tell our parent we're done. */
+  if (cur->children_ready)
+    hash_destroy (&cur->children, orphan_child);
+  if (cur->wait_status != NULL) 
+    {
+      struct wait_status *ws = cur->wait_status;
+      ws->exit_code = cur->exit_code;
+      sema_up (&ws->dead);
+      release_child (ws);
     }
 }
 
@@ -195,25 +496,52 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
-static bool setup_stack (void **esp);
+/* A loadable segment, from a valid program header. */
+struct elf_segment
+  {
+    uint32_t file_page;         /* Page-aligned offset in file. */
+    uint32_t mem_page;          /* Page-aligned user virtual address. */
+    uint32_t read_bytes;        /* Bytes to read from file. */
+    uint32_t zero_bytes;        /* Bytes to zero following them. */
+    bool writable;              /* Writable by the process? */
+    bool large;                 /* Use 4 MB pages where possible? */
+  };
+
+/* What load() needs from an executable's headers.  Parsed and
+   validated once, then cached with the executable's inode, so
+   that loading the same executable again skips reading and
+   checking its headers. */
+struct elf_info
+  {
+    bool valid;                 /* Headers valid? */
+    uintptr_t entry;            /* Entry point. */
+    size_t seg_cnt;             /* Number of segments. */
+    struct elf_segment segs[];  /* Loadable segments. */
+  };
+
+static struct elf_info *parse_elf (struct file *);
+static void keep_exec (struct inode *);
+static bool setup_stack (void **esp, const void *args, size_t args_size);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
-                          bool writable);
+                          bool writable, bool large);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
+/* Loads an ELF executable from EXEC's FILE_NAME into the current
+   thread, with EXEC's ARGS at the top of its stack.
    Stores the executable's entry point into *EIP
    and its initial stack pointer into *ESP.
    Returns true if successful, false otherwise. */
-bool
-load (const char *file_name, void (**eip) (void), void **esp) 
+static bool
+load (const struct exec_info *exec, void (**eip) (void), void **esp) 
 {
+  const char *file_name = exec->file_name;
   struct thread *t = thread_current ();
-  struct Elf32_Ehdr ehdr;
   struct file *file = NULL;
-  off_t file_ofs;
+  struct inode *inode;
+  struct elf_info *info;
   bool success = false;
-  int i;
+  size_t i;
 
   /* Allocate and activate page directory. */
   t->pagedir = pagedir_create ();
@@ -222,14 +550,86 @@ load (const char *file_name, void (**eip) (void), void **esp)
   process_activate ();
 
   /* Open executable file. */
-  file = filesys_open (file_name);
+  t->bin_file = file = filesys_open (file_name);
   if (file == NULL) 
     {
       printf ("load: %s: open failed\n", file_name);
       goto done; 
     }
+  file_deny_write (file);
+
+  /* Find the executable's headers in its inode's cache, or
+     parse and cache them.  Writes to the executable stay denied
+     until the process exits, so the cache stays valid while we
+     use it. */
+  inode = file_get_inode (file);
+  info = inode_get_exec_cache (inode);
+  if (info == NULL)
+    {
+      info = parse_elf (file);
+      if (info == NULL)
+        goto done;
+      if (!inode_set_exec_cache (inode, info, free))
+        {
+          /* Another process cached them first. */
+          free (info);
+          info = inode_get_exec_cache (inode);
+        }
+    }
+  keep_exec (inode);
+  if (!info->valid) 
+    {
+      printf ("load: %s: error loading executable\n", file_name);
+      goto done; 
+    }
+
+  /* Load segments. */
+  for (i = 0; i < info->seg_cnt; i++) 
+    {
+      const struct elf_segment *seg = &info->segs[i];
+      if (!load_segment (file, seg->file_page, (void *) seg->mem_page,
+                         seg->read_bytes, seg->zero_bytes, seg->writable,
+                         seg->large))
+        goto done;
+    }
+
+  /* Set up stack. */
+  if (!setup_stack (esp, exec->args, exec->args_size))
+    goto done;
+
+  /* Start address. */
+  *eip = (void (*) (void)) info->entry;
+
+  success = true;
+
+ done:
+  /* We arrive here whether the load is successful or not.  On
+     success, the executable stays open, denying writes, until
+     the process exits.  On failure, close it now, before our
+     parent learns of the failure and perhaps tries to write
+     it. */
+  if (!success) 
+    {
+      file_close (t->bin_file);
+      t->bin_file = NULL;
+    }
+  return success;
+}
+
+/* Reads and validates the headers of executable FILE.  Returns
+   a newly allocated elf_info, which is marked invalid if FILE is
+   not a loadable executable, or a null pointer if memory cannot
+   be allocated.  The caller must free() the elf_info. */
+static struct elf_info *
+parse_elf (struct file *file) 
+{
+  struct Elf32_Ehdr ehdr;
+  struct elf_info *info;
+  off_t file_ofs;
+  int i;
 
   /* Read and verify executable header. */
+  file_seek (file, 0);
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
       || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
       || ehdr.e_type != 2
@@ -238,22 +638,36 @@ load (const char *file_name, void (**eip) (void), void **esp)
       || ehdr.e_phentsize != sizeof (struct Elf32_Phdr)
       || ehdr.e_phnum > 1024) 
     {
-      printf ("load: %s: error loading executable\n", file_name);
-      goto done; 
+      info = malloc (sizeof *info);
+      if (info != NULL)
+        {
+          info->valid = false;
+          info->seg_cnt = 0;
+        }
+      return info;
     }
 
+  info = malloc (sizeof *info + ehdr.e_phnum * sizeof *info->segs);
+  if (info == NULL)
+    return NULL;
+  info->valid = false;
+  info->entry = ehdr.e_entry;
+  info->seg_cnt = 0;
+
   /* Read program headers. */
   file_ofs = ehdr.e_phoff;
   for (i = 0; i < ehdr.e_phnum; i++) 
     {
       struct Elf32_Phdr phdr;
+      struct elf_segment *seg;
+      uint32_t page_offset;
 
       if (file_ofs < 0 || file_ofs > file_length (file))
-        goto done;
+        goto invalid;
       file_seek (file, file_ofs);
 
       if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-        goto done;
+        goto invalid;
       file_ofs += sizeof phdr;
       switch (phdr.p_type) 
         {
@@ -267,58 +681,105 @@ load (const char *file_name, void (**eip) (void), void **esp)
         case PT_DYNAMIC:
         case PT_INTERP:
         case PT_SHLIB:
-          goto done;
+          goto invalid;
         case PT_LOAD:
-          if (validate_segment (&phdr, file)) 
+          if (!validate_segment (&phdr, file))
+            goto invalid;
+          seg = &info->segs[info->seg_cnt++];
+          seg->writable = (phdr.p_flags & PF_W) != 0;
+          seg->large = init_large_pages && phdr.p_align >= PTSPAN;
+          seg->file_page = phdr.p_offset & ~PGMASK;
+          seg->mem_page = phdr.p_vaddr & ~PGMASK;
+          page_offset = phdr.p_vaddr & PGMASK;
+          if (phdr.p_filesz > 0)
+            {
+              /* Normal segment.
+                 Read initial part from disk and zero the rest. */
+              seg->read_bytes = page_offset + phdr.p_filesz;
+              seg->zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz,
+                                           PGSIZE)
+                                 - seg->read_bytes);
+            }
+          else 
             {
-              bool writable = (phdr.p_flags & PF_W) != 0;
-              uint32_t file_page = phdr.p_offset & ~PGMASK;
-              uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
-              uint32_t page_offset = phdr.p_vaddr & PGMASK;
-              uint32_t read_bytes, zero_bytes;
-              if (phdr.p_filesz > 0)
-                {
-                  /* Normal segment.
-                     Read initial part from disk and zero the rest. */
-                  read_bytes = page_offset + phdr.p_filesz;
-                  zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-                                - read_bytes);
-                }
-              else 
-                {
-                  /* Entirely zero.
-                     Don't read anything from disk. */
-                  read_bytes = 0;
-                  zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
-                }
-              if (!load_segment (file, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable))
-                goto done;
+              /* Entirely zero.
+                 Don't read anything from disk. */
+              seg->read_bytes = 0;
+              seg->zero_bytes = ROUND_UP (page_offset + phdr.p_memsz,
+                                          PGSIZE);
             }
-          else
-            goto done;
           break;
         }
     }
+  info->valid = true;
+  return info;
 
-  /* Set up stack. */
-  if (!setup_stack (esp))
-    goto done;
+ invalid:
+  info->seg_cnt = 0;
+  return info;
+}
 
-  /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
+/* Moves INODE to the front of the recently loaded executables,
+   opening it if it was not already there.  The least recently
+   loaded executable falls off the end and is closed. */
+static void
+keep_exec (struct inode *inode) 
+{
+  struct inode *evicted = NULL;
+  size_t i;
 
-  success = true;
+  lock_acquire (&kept_execs_lock);
 
- done:
-  /* We arrive here whether the load is successful or not. */
-  file_close (file);
-  return success;
+  /* Find INODE, or else the slot to reuse. */
+  for (i = 0; i < EXEC_KEEP - 1; i++)
+    if (kept_execs[i] == inode || kept_execs[i] == NULL)
+      break;
+  if (kept_execs[i] != inode) 
+    {
+      evicted = kept_execs[i];
+      inode_reopen (inode);
+    }
+
+  /* Move INODE to the front. */
+  memmove (kept_execs + 1, kept_execs, i * sizeof *kept_execs);
+  kept_execs[0] = inode;
+  lock_release (&kept_execs_lock);
+
+  /* Closing may write to disk, so do it without the lock. */
+  inode_close (evicted);
 }
-
+
+/* Closes the kept executables that have been removed, or all of
+   them if ALL is true, keeping the rest in order. */
+static void
+drop_execs (bool all) 
+{
+  struct inode *closed[EXEC_KEEP];
+  size_t closed_cnt = 0;
+  size_t i, j;
+
+  lock_acquire (&kept_execs_lock);
+  for (i = j = 0; i < EXEC_KEEP; i++)
+    if (kept_execs[i] != NULL && (all || inode_is_removed (kept_execs[i])))
+      closed[closed_cnt++] = kept_execs[i];
+    else
+      kept_execs[j++] = kept_execs[i];
+  while (j < EXEC_KEEP)
+    kept_execs[j++] = NULL;
+  lock_release (&kept_execs_lock);
+
+  /* Closing may write to disk, so do it without the lock. */
+  for (i = 0; i < closed_cnt; i++)
+    inode_close (closed[i]);
+}
+
 /* load() helpers. */
 
+static void *get_user_page (void *upage, enum palloc_flags);
+static void free_user_page (void *kpage);
 static bool install_page (void *upage, void *kpage, bool writable);
+static bool install_zero_page (void *upage, bool writable);
+static bool install_large_page (void *upage, bool writable);
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -373,6 +834,13 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
           starting at offset OFS.
 
         - ZERO_BYTES bytes at UPAGE + READ_BYTES must be zeroed.
+          Pages that are entirely zero are mapped to the shared
+          zero page rather than given memory of their own.
+
+   If LARGE is true, then each 4 MB-aligned, entirely zero 4 MB
+   region is mapped with a single 4 MB page, if one is
+   available.  Programs opt into this by aligning a segment,
+   typically their BSS, on a 4 MB boundary.
 
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
@@ -381,7 +849,8 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    or disk read error occurs. */
 static bool
 load_segment (struct file *file, off_t ofs, uint8_t *upage,
-              uint32_t read_bytes, uint32_t zero_bytes, bool writable) 
+              uint32_t read_bytes, uint32_t zero_bytes, bool writable,
+              bool large) 
 {
   ASSERT ((read_bytes + zero_bytes) % PGSIZE == 0);
   ASSERT (pg_ofs (upage) == 0);
@@ -396,15 +865,37 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+      /* Use a 4 MB page for a 4 MB region with nothing to read,
+         if requested and if one is available. */
+      if (large && page_read_bytes == 0 && zero_bytes >= PTSPAN
+          && ((uintptr_t) upage & (PTSPAN - 1)) == 0
+          && install_large_page (upage, writable))
+        {
+          zero_bytes -= PTSPAN;
+          upage += PTSPAN;
+          continue;
+        }
+
+      /* A page with nothing to read shares the zero page until
+         it is first written. */
+      if (page_read_bytes == 0)
+        {
+          if (!install_zero_page (upage, writable))
+            return false;
+          zero_bytes -= page_zero_bytes;
+          upage += PGSIZE;
+          continue;
+        }
+
       /* Get a page of memory. */
-      uint8_t *kpage = palloc_get_page (PAL_USER);
+      uint8_t *kpage = get_user_page (upage, 0);
       if (kpage == NULL)
         return false;
 
       /* Load this page. */
       if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
         {
-          palloc_free_page (kpage);
+          free_user_page (kpage);
           return false; 
         }
       memset (kpage + page_read_bytes, 0, page_zero_bytes);
@@ -412,7 +903,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       /* Add the page to the process's address space. */
       if (!install_page (upage, kpage, writable)) 
         {
-          palloc_free_page (kpage);
+          free_user_page (kpage);
           return false; 
         }
 
@@ -425,23 +916,61 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+   user virtual memory, and copy the ARGS_SIZE bytes of prebuilt
+   arguments in ARGS to the top of it.  Arguments that fill more
+   than half the page get a second page below it, so that the
+   program still has room for its own stack. */
 static bool
-setup_stack (void **esp) 
+setup_stack (void **esp, const void *args, size_t args_size) 
 {
-  uint8_t *kpage;
-  bool success = false;
+  size_t page_cnt = args_size > PGSIZE / 2 ? 2 : 1;
+  size_t i;
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL) 
+  for (i = 0; i < page_cnt; i++) 
     {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
-        *esp = PHYS_BASE;
-      else
-        palloc_free_page (kpage);
+      uint8_t *upage = ((uint8_t *) PHYS_BASE) - (i + 1) * PGSIZE;
+      uint8_t *kpage = get_user_page (upage, PAL_ZERO);
+      if (kpage == NULL)
+        return false;
+      if (i == 0)
+        memcpy (kpage + PGSIZE - args_size, args, args_size);
+      if (!install_page (upage, kpage, true)) 
+        {
+          free_user_page (kpage);
+          return false;
+        }
     }
-  return success;
+  *esp = (uint8_t *) PHYS_BASE - args_size;
+  return true;
+}
+
+/* Obtains a page from the user pool to be mapped at user
+   virtual address UPAGE and returns its kernel virtual address,
+   or a null pointer if none is available.  If PAL_ZERO is set
+   in FLAGS, the page is filled with zeros. */
+static void *
+get_user_page (void *upage UNUSED, enum palloc_flags flags)
+{
+#ifdef VM
+  return frame_alloc (flags, upage);
+#else
+  void *kpage = palloc_get_page (PAL_USER | flags);
+  if (kpage == NULL && pagedir_reclaim ())
+    kpage = palloc_get_page (PAL_USER | flags);
+  return kpage;
+#endif
+}
+
+/* Frees KPAGE, which was obtained with get_user_page() but never
+   mapped. */
+static void
+free_user_page (void *kpage)
+{
+#ifdef VM
+  frame_free (kpage);
+#else
+  palloc_free_page (kpage);
+#endif
 }
 
 /* Adds a mapping from user virtual address UPAGE to kernel
@@ -449,8 +978,8 @@ setup_stack (void **esp)
    If WRITABLE is true, the user process may modify the page;
    otherwise, it is read-only.
    UPAGE must not already be mapped.
-   KPAGE should probably be a page obtained from the user pool
-   with palloc_get_page().
+   KPAGE should probably be a page obtained with
+   get_user_page().
    Returns true on success, false if UPAGE is already mapped or
    if memory allocation fails. */
 static bool
@@ -463,3 +992,47 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+
+/* Adds a mapping from user virtual address UPAGE to the shared
+   zero page.  If WRITABLE is true, the first write to UPAGE
+   gives the process a private copy; otherwise, it is read-only.
+   UPAGE must not already be mapped.
+   Returns true on success, false if UPAGE is already mapped or
+   if memory allocation fails. */
+static bool
+install_zero_page (void *upage, bool writable)
+{
+  struct thread *t = thread_current ();
+
+  return (pagedir_get_page (t->pagedir, upage) == NULL
+          && pagedir_set_zero_page (t->pagedir, upage, writable));
+}
+
+/* Adds a mapping from the 4 MB region of user virtual memory
+   starting at UPAGE, which must be aligned on a 4 MB boundary,
+   to 4 MB of newly allocated, zeroed memory.
+   If WRITABLE is true, the user process may modify the region;
+   otherwise, it is read-only.
+   Returns true on success, false if part of the region is
+   already mapped or if 4 MB of aligned memory isn't
+   available. */
+static bool
+install_large_page (void *upage, bool writable)
+{
+  struct thread *t = thread_current ();
+  void *kpage;
+
+  kpage = palloc_get_aligned (PAL_USER | PAL_ZERO, PTSPAN / PGSIZE,
+                              PTSPAN / PGSIZE);
+  if (kpage == NULL && pagedir_reclaim ())
+    kpage = palloc_get_aligned (PAL_USER | PAL_ZERO, PTSPAN / PGSIZE,
+                                PTSPAN / PGSIZE);
+  if (kpage == NULL)
+    return false;
+  if (!pagedir_set_large_page (t->pagedir, upage, kpage, writable))
+    {
+      palloc_free_multiple (kpage, PTSPAN / PGSIZE);
+      return false;
+    }
+  return true;
+}
@@ -3,7 +3,10 @@
 
 #include "threads/thread.h"
 
-tid_t process_execute (const char *file_name);
+void process_init (void);
+void process_done (void);
+void process_drop_removed (void);
+tid_t process_execute (const char *cmd_line);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
@@ -1,20 +1,958 @@
 #include "userprog/syscall.h"
+#include <iovec.h>
+#include <ring.h>
+#include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include "devices/input.h"
+#include "devices/shutdown.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/gdt.h"
+#include "userprog/msr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
+
+/* A system call handler.  Takes up to four 32-bit arguments,
+   already copied in from the user stack, and returns the value
+   to put in the caller's EAX. */
+typedef int syscall_function (int, int, int, int);
+
+/* A system call table entry. */
+struct syscall
+  {
+    size_t arg_cnt;             /* Number of arguments. */
+    syscall_function *func;     /* Implementation. */
+  };
+
+static syscall_function sys_halt, sys_exit, sys_exec, sys_wait;
+static syscall_function sys_create, sys_remove, sys_open, sys_filesize;
+static syscall_function sys_read, sys_write, sys_seek, sys_tell;
+static syscall_function sys_close, sys_isdir, sys_inumber;
+static syscall_function sys_readv, sys_writev, sys_pread, sys_pwrite;
+static syscall_function sys_ring_setup, sys_ring_enter;
+
+/* System calls, indexed by number.  Calls with a null FUNC are
+   not supported by this kernel. */
+static const struct syscall syscall_table[] =
+  {
+    [SYS_HALT] = {0, sys_halt},
+    [SYS_EXIT] = {1, sys_exit},
+    [SYS_EXEC] = {1, sys_exec},
+    [SYS_WAIT] = {1, sys_wait},
+    [SYS_CREATE] = {2, sys_create},
+    [SYS_REMOVE] = {1, sys_remove},
+    [SYS_OPEN] = {1, sys_open},
+    [SYS_FILESIZE] = {1, sys_filesize},
+    [SYS_READ] = {3, sys_read},
+    [SYS_WRITE] = {3, sys_write},
+    [SYS_SEEK] = {2, sys_seek},
+    [SYS_TELL] = {1, sys_tell},
+    [SYS_CLOSE] = {1, sys_close},
+    [SYS_MMAP] = {2, NULL},
+    [SYS_MUNMAP] = {1, NULL},
+    [SYS_CHDIR] = {1, NULL},
+    [SYS_MKDIR] = {1, NULL},
+    [SYS_READDIR] = {2, NULL},
+    [SYS_ISDIR] = {1, sys_isdir},
+    [SYS_INUMBER] = {1, sys_inumber},
+    [SYS_READV] = {3, sys_readv},
+    [SYS_WRITEV] = {3, sys_writev},
+    [SYS_PREAD] = {4, sys_pread},
+    [SYS_PWRITE] = {4, sys_pwrite},
+    [SYS_RING_SETUP] = {1, sys_ring_setup},
+    [SYS_RING_ENTER] = {1, sys_ring_enter},
+  };
+
+#define SYSCALL_CNT (sizeof syscall_table / sizeof *syscall_table)
+
+/* File descriptor table.
+
+   A process's open files live in an array indexed by file
+   descriptor, so that looking one up is a bounds check and an
+   array load.  A bitmap alongside marks the slots in use, so that
+   opening a file takes the lowest free descriptor a word at a
+   time.  Slots 0 and 1, for the console, are marked in use but
+   hold no file.
+
+   The table starts out as the FD_EMBED slots inside struct
+   thread, which is enough for most processes.  Once those fill
+   up, it moves to pages obtained from palloc, with the bitmap
+   after the array in the same block, and doubles in size each
+   time it fills again.  A thread that has never opened a file
+   has an empty table. */
 
 static void syscall_handler (struct intr_frame *);
+void syscall_sysenter (void);
+static void copy_in (void *dst, const void *usrc, size_t size);
+static void copy_out (void *udst, const void *src, size_t size);
+static char *copy_in_string (const char *us);
+static int alloc_fd (struct thread *, struct file *);
+static void free_fd (struct thread *, int handle);
+static struct file *find_fd (int handle);
+static struct file *lookup_fd (int handle);
 
+/* Registers both system call entry paths: the "int $0x30"
+   interrupt gate, and the faster SYSENTER instruction, which the
+   user library uses if the CPU supports it.  On a CPU without
+   SYSENTER, the user library falls back to "int $0x30", so we
+   leave the MSRs alone.  SYSEXIT derives the user segments from
+   MSR_SYSENTER_CS, which works because gdt.c places SEL_UCSEG
+   and SEL_UDSEG right after the kernel segments.  tss_update()
+   keeps MSR_SYSENTER_ESP pointing to the running thread's kernel
+   stack. */
 void
-syscall_init (void) 
+syscall_init (void)
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+
+  if (cpu_has_sysenter ()) 
+    {
+      wrmsr (MSR_SYSENTER_CS, SEL_KCSEG);
+      wrmsr (MSR_SYSENTER_EIP, (uint32_t) syscall_sysenter);
+    }
+}
+
+/* System call handler for "int $0x30". */
+static void
+syscall_handler (struct intr_frame *f)
+{
+  f->eax = syscall_dispatch (f->esp);
+}
+
+/* Carries out the system call whose number and arguments are on
+   the user stack at ESP, and returns its result.  Called by
+   syscall_handler() and by the SYSENTER entry stub in
+   syscall-entry.S.
+
+   Looks up the call number at the top of the user stack in
+   syscall_table[], copies in as many arguments as the entry
+   says, and calls the implementation. */
+int
+syscall_dispatch (const void *esp)
+{
+  const struct syscall *sc;
+  unsigned call_nr;
+  int args[4];
+
+  copy_in (&call_nr, esp, sizeof call_nr);
+  if (call_nr >= SYSCALL_CNT || syscall_table[call_nr].func == NULL)
+    sys_exit (-1, 0, 0, 0);
+  sc = &syscall_table[call_nr];
+
+  ASSERT (sc->arg_cnt <= sizeof args / sizeof *args);
+  copy_in (args, (uint32_t *) esp + 1, sizeof *args * sc->arg_cnt);
+  return sc->func (args[0], args[1], args[2], args[3]);
+}
+
+/* User memory access.
+
+   Each primitive below loads the address of the instruction
+   after its access into EAX before touching user memory.  If
+   the access faults, page_fault() (in userprog/exception.c)
+   resumes execution at that address with EAX set to -1, so a bad
+   pointer costs nothing unless it is actually bad.  The callers
+   only have to check that the range lies below PHYS_BASE. */
+
+/* Reads a byte at user virtual address UADDR, which must be
+   below PHYS_BASE.  Returns the byte value if successful, -1 if
+   a page fault occurred. */
+static inline int
+get_user (const uint8_t *uaddr)
+{
+  int result;
+  asm ("movl $1f, %0; movzbl %1, %0; 1:"
+       : "=&a" (result) : "m" (*uaddr));
+  return result;
+}
+
+/* Returns true if the SIZE bytes starting at user virtual
+   address UADDR lie entirely below PHYS_BASE. */
+static inline bool
+is_user_range (const void *uaddr, size_t size)
+{
+  return (uintptr_t) uaddr + size >= (uintptr_t) uaddr
+         && (uintptr_t) uaddr + size <= (uintptr_t) PHYS_BASE;
+}
+
+/* Copies SIZE bytes from kernel address SRC to kernel address
+   DST with a single string move, either of which may be a user
+   address below PHYS_BASE.  Returns true if successful, false if
+   a page fault occurred. */
+static inline bool
+move_bytes (void *dst, const void *src, size_t size)
+{
+  int result;
+  asm volatile ("movl $1f, %0; rep movsb; 1:"
+                : "=&a" (result), "+D" (dst), "+S" (src), "+c" (size)
+                : : "memory");
+  return result != -1;
+}
+
+/* Writes BYTE to user address UDST, which must be below
+   PHYS_BASE.  Returns true if successful, false if a page fault
+   occurred. */
+static inline bool
+put_user (uint8_t *udst, uint8_t byte)
+{
+  int error_code;
+  asm ("movl $1f, %0; movb %b2, %1; 1:"
+       : "=&a" (error_code), "=m" (*udst) : "q" (byte));
+  return error_code != -1;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.  Terminates the process if any of the user bytes is
+   invalid. */
+static void
+copy_in (void *dst, const void *usrc, size_t size)
+{
+  if (!is_user_range (usrc, size) || !move_bytes (dst, usrc, size))
+    sys_exit (-1, 0, 0, 0);
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address
+   UDST.  Terminates the process if any of the user bytes is
+   invalid. */
+static void
+copy_out (void *udst, const void *src, size_t size)
+{
+  if (!is_user_range (udst, size) || !move_bytes (udst, src, size))
+    sys_exit (-1, 0, 0, 0);
 }
 
+/* Pinning.
+
+   read and write transfer data directly between the file system
+   and the caller's buffer, so that each byte is copied once,
+   and full sectors go straight between the disk and the user
+   page.  File system code must not fault on the buffer, since
+   it may hold locks, so the buffer's pages are first faulted in
+   (unsharing copy-on-write pages, for a read) and pinned, which
+   keeps them resident.  Large transfers are done a chunk at a
+   time, so that one process cannot pin a large share of user
+   memory. */
+
+/* Maximum number of pages pinned at once by one system call. */
+#define PIN_PAGES 16
+
+/* Returns the number of bytes, up to SIZE, starting at user
+   address UADDR that can be pinned at once. */
+static size_t
+pin_chunk_size (const void *uaddr, size_t size)
+{
+  size_t max = PIN_PAGES * PGSIZE - pg_ofs (uaddr);
+  return size < max ? size : max;
+}
+
+/* Unpins the user pages spanning the SIZE bytes at UADDR. */
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+unpin_user_range (const void *uaddr, size_t size)
+{
+#ifdef VM
+  const uint8_t *page;
+
+  for (page = pg_round_down (uaddr); page < (const uint8_t *) uaddr + size;
+       page += PGSIZE)
+    frame_unpin ((void *) page);
+#else
+  /* Without VM, user pages are never evicted. */
+  (void) uaddr;
+  (void) size;
+#endif
+}
+
+/* Faults in and pins the user pages spanning the SIZE bytes at
+   UADDR, making sure they are writable if WRITABLE is true.
+   The range must be below PHYS_BASE.  Returns true if
+   successful, false (with nothing left pinned) if any page is
+   invalid. */
+static bool
+pin_user_range (const void *uaddr, size_t size, bool writable)
+{
+  const uint8_t *start = uaddr;
+  const uint8_t *page;
+
+  for (page = pg_round_down (start); page < start + size; page += PGSIZE)
+    {
+      uint8_t *p = (uint8_t *) (page < start ? start : page);
+
+      for (;;)
+        {
+          int c = get_user (p);
+          if (c == -1 || (writable && !put_user (p, c)))
+            {
+              if (page > start)
+                unpin_user_range (start, page - start);
+              return false;
+            }
+#ifdef VM
+          /* The page may be evicted again before we pin it. */
+          if (frame_pin ((void *) page))
+            break;
+#else
+          break;
+#endif
+        }
+    }
+  return true;
+}
+
+/* Creates a copy of user string US in kernel memory and returns
+   it as a page that must be freed with palloc_free_page().
+   Truncates the string at PGSIZE bytes in size.  Terminates the
+   process if any part of the string is invalid. */
+static char *
+copy_in_string (const char *us)
+{
+  char *ks;
+  size_t length;
+
+  ks = palloc_get_page (0);
+  if (ks == NULL)
+    thread_exit ();
+
+  for (length = 0; length < PGSIZE; length++)
+    {
+      int c;
+
+      if (us + length >= (char *) PHYS_BASE
+          || (c = get_user ((const uint8_t *) us + length)) == -1)
+        {
+          palloc_free_page (ks);
+          sys_exit (-1, 0, 0, 0);
+        }
+      ks[length] = c;
+      if (c == '\0')
+        return ks;
+    }
+  ks[PGSIZE - 1] = '\0';
+  return ks;
+}
+
+/* Halt system call. */
+static int
+sys_halt (int arg0 UNUSED, int arg1 UNUSED, int arg2 UNUSED, int arg3 UNUSED)
+{
+  shutdown_power_off ();
+}
+
+/* Exit system call. */
+static int
+sys_exit (int exit_code, int arg1 UNUSED, int arg2 UNUSED, int arg3 UNUSED)
 {
-  printf ("system call!\n");
+  thread_current ()->exit_code = exit_code;
   thread_exit ();
+  NOT_REACHED ();
+}
+
+/* Exec system call. */
+static int
+sys_exec (int ufile, int arg1 UNUSED, int arg2 UNUSED, int arg3 UNUSED)
+{
+  char *kfile = copy_in_string ((const char *) ufile);
+  tid_t tid = process_execute (kfile);
+  palloc_free_page (kfile);
+  return tid;
+}
+
+/* Wait system call. */
+static int
+sys_wait (int child, int arg1 UNUSED, int arg2 UNUSED, int arg3 UNUSED)
+{
+  return process_wait (child);
+}
+
+/* Create system call. */
+static int
+sys_create (int ufile, int initial_size, int arg2 UNUSED, int arg3 UNUSED)
+{
+  char *kfile = copy_in_string ((const char *) ufile);
+  bool ok = filesys_create (kfile, initial_size);
+  palloc_free_page (kfile);
+  return ok;
+}
+
+/* Remove system call. */
+static int
+sys_remove (int ufile, int arg1 UNUSED, int arg2 UNUSED, int arg3 UNUSED)
+{
+  char *kfile = copy_in_string ((const char *) ufile);
+  bool ok = filesys_remove (kfile);
+  palloc_free_page (kfile);
+  if (ok)
+    process_drop_removed ();
+  return ok;
+}
+
+/* Open system call. */
+static int
+sys_open (int ufile, int arg1 UNUSED, int arg2 UNUSED, int arg3 UNUSED)
+{
+  struct thread *cur = thread_current ();
+  char *kfile = copy_in_string ((const char *) ufile);
+  struct file *file;
+  int handle = -1;
+
+  file = filesys_open (kfile);
+  if (file != NULL)
+    {
+      handle = alloc_fd (cur, file);
+      if (handle < 0)
+        file_close (file);
+    }
+  palloc_free_page (kfile);
+  return handle;
+}
+
+/* Returns the number of pages needed for a file descriptor table
+   with SLOT_CNT slots, plus its bitmap. */
+static size_t
+fd_table_pages (int slot_cnt)
+{
+  return DIV_ROUND_UP (slot_cnt * sizeof (struct file *) + slot_cnt / 8,
+                       PGSIZE);
+}
+
+/* Moves T's file descriptor table into a larger block of pages:
+   one page if it is embedded in T, otherwise twice as many pages
+   as it occupies now.  Returns true if successful,
+   false if memory is exhausted. */
+static bool
+grow_fds (struct thread *t)
+{
+  size_t page_cnt;
+  struct file **fds;
+  uint32_t *used;
+  int slot_cnt;
+
+  page_cnt = t->fds == t->fd_embed ? 1 : 2 * fd_table_pages (t->fd_cnt);
+  slot_cnt = page_cnt * PGSIZE * 8 / (8 * sizeof *fds + 1) / 32 * 32;
+  fds = palloc_get_multiple (PAL_ZERO, page_cnt);
+  if (fds == NULL)
+    return false;
+  used = (uint32_t *) (fds + slot_cnt);
+
+  /* Copy the old table.  An embedded table's bitmap word has
+     bits set past its end, which must be cleared. */
+  memcpy (fds, t->fds, t->fd_cnt * sizeof *fds);
+  memcpy (used, t->fd_used, DIV_ROUND_UP (t->fd_cnt, 32) * sizeof *used);
+  if (t->fd_cnt % 32 != 0)
+    used[t->fd_cnt / 32] &= (1u << t->fd_cnt % 32) - 1;
+  if (t->fds != t->fd_embed)
+    palloc_free_multiple (t->fds, fd_table_pages (t->fd_cnt));
+
+  t->fd_scan = t->fd_cnt / 32;
+  t->fds = fds;
+  t->fd_used = used;
+  t->fd_cnt = slot_cnt;
+  return true;
+}
+
+/* Installs FILE in the lowest free slot in T's file descriptor
+   table, growing the table if it is full, and returns the slot's
+   file descriptor.  Returns -1 if memory is exhausted. */
+static int
+alloc_fd (struct thread *t, struct file *file)
+{
+  int word_cnt, w;
+
+  if (t->fds == NULL)
+    {
+      /* First file opened: use the embedded table.  Slots past
+         its end are marked in use so that they are never
+         chosen. */
+      t->fds = t->fd_embed;
+      t->fd_used = &t->fd_embed_used;
+      t->fd_cnt = FD_EMBED;
+      t->fd_embed_used = ~((1u << FD_EMBED) - 1) | 0x3;
+      t->fd_scan = 0;
+    }
+
+  for (;;)
+    {
+      word_cnt = DIV_ROUND_UP (t->fd_cnt, 32);
+      for (w = t->fd_scan; w < word_cnt; w++)
+        if (t->fd_used[w] != UINT32_MAX)
+          {
+            int handle = w * 32 + __builtin_ctz (~t->fd_used[w]);
+            t->fd_used[w] |= 1u << handle % 32;
+            t->fds[handle] = file;
+            t->fd_scan = w;
+            return handle;
+          }
+      t->fd_scan = word_cnt;
+      if (!grow_fds (t))
+        return -1;
+    }
+}
+
+/* Frees HANDLE, which must be open, in T's file descriptor
+   table. */
+static void
+free_fd (struct thread *t, int handle)
+{
+  t->fds[handle] = NULL;
+  t->fd_used[handle / 32] &= ~(1u << handle % 32);
+  if (handle / 32 < t->fd_scan)
+    t->fd_scan = handle / 32;
+}
+
+/* Returns the file associated with HANDLE in the current
+   process, or a null pointer if HANDLE is not open. */
+static struct file *
+find_fd (int handle)
+{
+  struct thread *cur = thread_current ();
+
+  if (handle < 0 || handle >= cur->fd_cnt)
+    return NULL;
+  return cur->fds[handle];
+}
+
+/* Returns the file associated with HANDLE in the current
+   process.  Terminates the process if HANDLE is not open. */
+static struct file *
+lookup_fd (int handle)
+{
+  struct file *file = find_fd (handle);
+  if (file == NULL)
+    sys_exit (-1, 0, 0, 0);
+  return file;
+}
+
+/* Filesize system call. */
+static int
+sys_filesize (int handle, int arg1 UNUSED, int arg2 UNUSED, int arg3 UNUSED)
+{
+  return file_length (lookup_fd (handle));
+}
+
+/* Transfers SIZE bytes between FILE and user buffer UBUF, a
+   pinned chunk at a time: reads into UBUF if READ is true,
+   otherwise writes from it.  Starts at the file's position,
+   advancing it, if OFS is negative, otherwise at byte offset OFS.
+   UBUF must lie below PHYS_BASE.  Terminates the process if any
+   of UBUF is invalid.  Returns the number of bytes
+   transferred. */
+static int
+transfer_file (struct file *file, uint8_t *ubuf, size_t size, off_t ofs,
+               bool read)
+{
+  int bytes_done = 0;
+
+  while (size > 0)
+    {
+      uint8_t *buf = ubuf + bytes_done;
+      size_t chunk = pin_chunk_size (buf, size);
+      off_t retval;
+
+      if (!pin_user_range (buf, chunk, read))
+        sys_exit (-1, 0, 0, 0);
+      if (ofs < 0)
+        retval = read ? file_read (file, buf, chunk)
+                      : file_write (file, buf, chunk);
+      else
+        retval = read ? file_read_at (file, buf, chunk, ofs + bytes_done)
+                      : file_write_at (file, buf, chunk, ofs + bytes_done);
+      unpin_user_range (buf, chunk);
+
+      if (retval > 0)
+        {
+          bytes_done += retval;
+          size -= retval;
+        }
+      if (retval != (off_t) chunk)
+        break;
+    }
+
+  return bytes_done;
+}
+
+/* Reads SIZE bytes from the keyboard into user buffer UDST.
+   Returns SIZE. */
+static int
+read_console (uint8_t *udst, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    {
+      uint8_t c = input_getc ();
+      copy_out (udst + i, &c, 1);
+    }
+  return size;
+}
+
+/* Writes SIZE bytes from user buffer USRC to the console, a
+   pinned chunk at a time.  Returns SIZE. */
+static int
+write_console (const uint8_t *usrc, size_t size)
+{
+  size_t bytes_written = 0;
+
+  while (bytes_written < size)
+    {
+      const uint8_t *buf = usrc + bytes_written;
+      size_t chunk = pin_chunk_size (buf, size - bytes_written);
+
+      if (!pin_user_range (buf, chunk, false))
+        sys_exit (-1, 0, 0, 0);
+      putbuf ((const char *) buf, chunk);
+      unpin_user_range (buf, chunk);
+      bytes_written += chunk;
+    }
+  return size;
+}
+
+/* Read system call.  Reads straight into the caller's buffer,
+   a pinned chunk at a time. */
+static int
+sys_read (int handle, int udst_, int size, int arg3 UNUSED)
+{
+  uint8_t *udst = (uint8_t *) udst_;
+
+  if (!is_user_range (udst, (unsigned) size))
+    sys_exit (-1, 0, 0, 0);
+  if (handle == STDIN_FILENO)
+    return read_console (udst, size);
+  return transfer_file (lookup_fd (handle), udst, size, -1, true);
+}
+
+/* Write system call.  Writes straight from the caller's buffer,
+   a pinned chunk at a time. */
+static int
+sys_write (int handle, int usrc_, int size, int arg3 UNUSED)
+{
+  uint8_t *usrc = (uint8_t *) usrc_;
+
+  if (!is_user_range (usrc, (unsigned) size))
+    sys_exit (-1, 0, 0, 0);
+  if (handle == STDOUT_FILENO)
+    return write_console (usrc, size);
+  return transfer_file (lookup_fd (handle), usrc, size, -1, false);
+}
+
+/* Seek system call. */
+static int
+sys_seek (int handle, int position, int arg2 UNUSED, int arg3 UNUSED)
+{
+  if ((off_t) position >= 0)
+    file_seek (lookup_fd (handle), position);
+  return 0;
+}
+
+/* Tell system call. */
+static int
+sys_tell (int handle, int arg1 UNUSED, int arg2 UNUSED, int arg3 UNUSED)
+{
+  return file_tell (lookup_fd (handle));
+}
+
+/* Close system call. */
+static int
+sys_close (int handle, int arg1 UNUSED, int arg2 UNUSED, int arg3 UNUSED)
+{
+  struct thread *cur = thread_current ();
+  file_close (lookup_fd (handle));
+  free_fd (cur, handle);
+  return 0;
+}
+
+/* Isdir system call.  This file system has only the root
+   directory, which cannot be opened, so no descriptor refers to
+   a directory. */
+static int
+sys_isdir (int handle, int arg1 UNUSED, int arg2 UNUSED, int arg3 UNUSED)
+{
+  lookup_fd (handle);
+  return false;
+}
+
+/* Inumber system call. */
+static int
+sys_inumber (int handle, int arg1 UNUSED, int arg2 UNUSED, int arg3 UNUSED)
+{
+  return inode_get_inumber (file_get_inode (lookup_fd (handle)));
+}
+
+/* Unpins the CNT buffers in IOV. */
+static void
+unpin_vector (const struct iovec *iov, int cnt)
+{
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    unpin_user_range (iov[i].iov_base, iov[i].iov_len);
+}
+
+/* Reads (if READ is true) or writes the CNT pinned buffers in
+   IOV on FILE in a single file system call, then unpins them.
+   Terminates the process if any buffer cannot be pinned.
+   Returns the number of bytes transferred. */
+static int
+transfer_pinned (struct file *file, const struct iovec *iov, int cnt,
+                 bool read)
+{
+  int retval;
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    if (!pin_user_range (iov[i].iov_base, iov[i].iov_len, read))
+      {
+        unpin_vector (iov, i);
+        sys_exit (-1, 0, 0, 0);
+      }
+  retval = read ? file_readv (file, iov, cnt) : file_writev (file, iov, cnt);
+  unpin_vector (iov, cnt);
+  return retval;
+}
+
+/* Implements readv (if READ is true) or writev: transfers the
+   CNT user buffers described by the user array UIOV on HANDLE.
+   Buffers are pinned and passed to the file system in batches
+   of at most PIN_PAGES pages, so the inode is locked once per
+   batch instead of once per buffer. */
+static int
+transfer_vector (int handle, const struct iovec *uiov, int cnt, bool read)
+{
+  struct iovec iov[IOV_MAX];
+  struct iovec batch[IOV_MAX];
+  struct file *file;
+  int batch_cnt = 0;
+  size_t batch_pages = 0, batch_size = 0;
+  int total = 0;
+  int i;
+
+  if (cnt < 0 || cnt > IOV_MAX)
+    return -1;
+  copy_in (iov, uiov, sizeof *iov * cnt);
+  for (i = 0; i < cnt; i++)
+    if (!is_user_range (iov[i].iov_base, iov[i].iov_len))
+      sys_exit (-1, 0, 0, 0);
+
+  if (read ? handle == STDIN_FILENO : handle == STDOUT_FILENO)
+    {
+      for (i = 0; i < cnt; i++)
+        total += (read ? read_console (iov[i].iov_base, iov[i].iov_len)
+                  : write_console (iov[i].iov_base, iov[i].iov_len));
+      return total;
+    }
+  file = lookup_fd (handle);
+
+  for (i = 0; i < cnt; i++)
+    {
+      uint8_t *base = iov[i].iov_base;
+      size_t left = iov[i].iov_len;
+
+      while (left > 0)
+        {
+          size_t room, size;
+
+          if (batch_pages == PIN_PAGES || batch_cnt == IOV_MAX)
+            {
+              /* Batch is full. */
+              int retval = transfer_pinned (file, batch, batch_cnt, read);
+              total += retval;
+              if ((size_t) retval != batch_size)
+                return total;
+              batch_cnt = batch_pages = batch_size = 0;
+            }
+
+          room = (PIN_PAGES - batch_pages) * PGSIZE - pg_ofs (base);
+          size = left < room ? left : room;
+          batch[batch_cnt].iov_base = base;
+          batch[batch_cnt].iov_len = size;
+          batch_cnt++;
+          batch_pages += DIV_ROUND_UP (pg_ofs (base) + size, PGSIZE);
+          batch_size += size;
+          base += size;
+          left -= size;
+        }
+    }
+  if (batch_cnt > 0)
+    total += transfer_pinned (file, batch, batch_cnt, read);
+
+  return total;
+}
+
+/* Readv system call. */
+static int
+sys_readv (int handle, int uiov, int cnt, int arg3 UNUSED)
+{
+  return transfer_vector (handle, (const struct iovec *) uiov, cnt, true);
+}
+
+/* Writev system call. */
+static int
+sys_writev (int handle, int uiov, int cnt, int arg3 UNUSED)
+{
+  return transfer_vector (handle, (const struct iovec *) uiov, cnt, false);
+}
+
+/* Pread system call.  Like read, but reads at byte offset OFS
+   without using or changing the file position. */
+static int
+sys_pread (int handle, int udst_, int size, int ofs)
+{
+  uint8_t *udst = (uint8_t *) udst_;
+  struct file *file;
+
+  if (!is_user_range (udst, (unsigned) size))
+    sys_exit (-1, 0, 0, 0);
+  file = lookup_fd (handle);
+  if (ofs < 0)
+    return -1;
+  return transfer_file (file, udst, size, ofs, true);
+}
+
+/* Pwrite system call.  Like write, but writes at byte offset
+   OFS without using or changing the file position. */
+static int
+sys_pwrite (int handle, int usrc_, int size, int ofs)
+{
+  uint8_t *usrc = (uint8_t *) usrc_;
+  struct file *file;
+
+  if (!is_user_range (usrc, (unsigned) size))
+    sys_exit (-1, 0, 0, 0);
+  file = lookup_fd (handle);
+  if (ofs < 0)
+    return -1;
+  return transfer_file (file, usrc, size, ofs, false);
+}
+
+/* Ring_setup system call.  Registers the struct ring at user
+   address URING, which must be page-aligned, as the process's
+   ring.  The page stays pinned, and the kernel reaches it
+   through its kernel mapping, until the process exits.  Returns
+   false if URING is misaligned or a ring is already
+   registered. */
+static int
+sys_ring_setup (int uring_, int arg1 UNUSED, int arg2 UNUSED,
+                int arg3 UNUSED)
+{
+  struct thread *cur = thread_current ();
+  void *uring = (void *) uring_;
+
+  if (cur->ring != NULL || pg_ofs (uring) != 0)
+    return false;
+  if (!is_user_range (uring, PGSIZE)
+      || !pin_user_range (uring, PGSIZE, true))
+    sys_exit (-1, 0, 0, 0);
+
+  /* Start with both queues empty. */
+  cur->ring = pagedir_get_page (cur->pagedir, uring);
+  cur->ring_upage = uring;
+  memset (cur->ring, 0, sizeof *cur->ring);
+  return true;
+}
+
+/* Carries out submission SQE, which has already been copied out
+   of the shared ring, and returns its result.  Buffer pointers
+   are checked as for read and write, terminating the process if
+   they are bad, but an unknown file descriptor or opcode just
+   yields -1. */
+static int
+ring_execute (const struct ring_sqe *sqe)
+{
+  uint8_t *ubuf = sqe->buf;
+  struct file *file;
+  bool read;
+
+  switch (sqe->opcode)
+    {
+    case RING_NOP:
+      return 0;
+
+    case RING_READ:
+    case RING_WRITE:
+      read = sqe->opcode == RING_READ;
+      if (!is_user_range (ubuf, sqe->len))
+        sys_exit (-1, 0, 0, 0);
+      if (read && sqe->fd == STDIN_FILENO)
+        return read_console (ubuf, sqe->len);
+      if (!read && sqe->fd == STDOUT_FILENO)
+        return write_console (ubuf, sqe->len);
+      file = find_fd (sqe->fd);
+      if (file == NULL)
+        return -1;
+      return transfer_file (file, ubuf, sqe->len, sqe->ofs, read);
+
+    default:
+      return -1;
+    }
+}
+
+/* Ring_enter system call.  Consumes up to TO_SUBMIT queued
+   submissions from the process's ring, posting a completion for
+   each.  Stops early if the submission queue empties or the
+   completion queue fills.  Returns the number of submissions
+   consumed, or -1 if no ring is registered. */
+static int
+sys_ring_enter (int to_submit, int arg1 UNUSED, int arg2 UNUSED,
+                int arg3 UNUSED)
+{
+  struct ring *ring = thread_current ()->ring;
+  int done;
+
+  if (ring == NULL)
+    return -1;
+
+  for (done = 0; done < to_submit; done++)
+    {
+      uint32_t head = ring->sq_head;
+      uint32_t tail = ring->cq_tail;
+      struct ring_sqe sqe;
+      struct ring_cqe *cqe;
+
+      if (head == ring->sq_tail || tail - ring->cq_head >= RING_CQ_ENTRIES)
+        break;
+
+      /* Copy the submission before looking at it, so that the
+         process cannot change it underneath us. */
+      sqe = ring->sq[head % RING_SQ_ENTRIES];
+      ring->sq_head = head + 1;
+
+      cqe = &ring->cq[tail % RING_CQ_ENTRIES];
+      cqe->user_data = sqe.user_data;
+      cqe->result = ring_execute (&sqe);
+      barrier ();
+      ring->cq_tail = tail + 1;
+    }
+
+  return done;
+}
+
+/* On thread exit, closes all open file descriptors and unpins
+   the registered ring, if any. */
+void
+syscall_exit (void)
+{
+  struct thread *cur = thread_current ();
+  int i;
+
+  for (i = 0; i < cur->fd_cnt; i++)
+    file_close (cur->fds[i]);
+  if (cur->fds != NULL && cur->fds != cur->fd_embed)
+    palloc_free_multiple (cur->fds, fd_table_pages (cur->fd_cnt));
+  cur->fds = NULL;
+  cur->fd_cnt = 0;
+
+  if (cur->ring != NULL)
+    {
+      unpin_user_range (cur->ring_upage, PGSIZE);
+      cur->ring = NULL;
+    }
 }
@@ -2,5 +2,7 @@
 #define USERPROG_SYSCALL_H
 
 void syscall_init (void);
+int syscall_dispatch (const void *esp);
+void syscall_exit (void);
 
 #endif /* userprog/syscall.h */
@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <stddef.h>
 #include "userprog/gdt.h"
+#include "userprog/msr.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -75,6 +76,13 @@ struct tss
 /* Kernel TSS. */
 static struct tss *tss;
 
+/* True if the CPU supports SYSENTER.  SYSENTER does not consult
+   the TSS, so its stack pointer register must follow esp0. */
+static bool sysenter;
+
+/* Value last written to MSR_SYSENTER_ESP. */
+static uint32_t sysenter_esp;
+
 /* Initializes the kernel TSS. */
 void
 tss_init (void) 
@@ -85,6 +93,7 @@ tss_init (void)
   tss = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   tss->ss0 = SEL_KDSEG;
   tss->bitmap = 0xdfff;
+  sysenter = cpu_has_sysenter ();
   tss_update ();
 }
 
@@ -96,11 +105,22 @@ tss_get (void)
   return tss;
 }
 
-/* Sets the ring 0 stack pointer in the TSS to point to the end
-   of the thread stack. */
+/* Sets the ring 0 stack pointer in the TSS, and the SYSENTER
+   stack pointer, to point to the end of the thread stack.
+   Writing an MSR is slow and only user processes execute
+   SYSENTER, so the SYSENTER stack pointer is left alone for
+   kernel threads and when it already has the right value. */
 void
 tss_update (void) 
 {
+  struct thread *t = thread_current ();
+
   ASSERT (tss != NULL);
-  tss->esp0 = (uint8_t *) thread_current () + PGSIZE;
+  tss->esp0 = (uint8_t *) t + PGSIZE;
+  if (sysenter && t->pagedir != NULL
+      && sysenter_esp != (uint32_t) tss->esp0)
+    {
+      sysenter_esp = (uint32_t) tss->esp0;
+      wrmsr (MSR_SYSENTER_ESP, sysenter_esp);
+    }
 }
@@ -0,0 +1,74 @@
+#include "userprog/vmstats.h"
+#include <stdio.h>
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Per-process virtual memory statistics.
+
+   Each user process counts the page faults it takes, broken
+   down by kind, and keeps a histogram of how long the kernel
+   took to service them, measured with the CPU's time stamp
+   counter.  With virtual memory, it also counts the evictions
+   its allocations caused and its own pages' trips through swap.
+   The numbers are printed when the process exits if
+   the "-vmstats" kernel option was given; they are meant for
+   choosing a good user pool size with "-ul". */
+
+/* If true, print each process's statistics when it exits.
+   Controlled by kernel command-line option "-vmstats". */
+bool vmstats_enabled;
+
+/* Names of fault kinds, for printing. */
+static const char *fault_kind_names[FAULT_KIND_CNT] =
+  {
+    "cow",
+    "swap-in",
+    "invalid",
+  };
+
+/* Records a page fault of the given KIND in the running
+   thread's statistics.  START is the value that rdtsc()
+   returned when the fault was entered. */
+void
+vmstats_fault (enum fault_kind kind, uint64_t start)
+{
+  struct vmstats *vs = &thread_current ()->vmstats;
+  uint64_t cycles = rdtsc () - start;
+  int bucket = 0;
+
+  while (cycles > 1 && bucket < VMSTATS_HIST_CNT - 1)
+    {
+      cycles >>= 1;
+      bucket++;
+    }
+  vs->faults[kind]++;
+  vs->hist[bucket]++;
+}
+
+/* Prints the running process's statistics, if enabled. */
+void
+vmstats_print (void)
+{
+  const struct vmstats *vs = &thread_current ()->vmstats;
+  int i;
+
+  if (!vmstats_enabled)
+    return;
+
+  printf ("%s: vmstats: faults:", thread_name ());
+  for (i = 0; i < FAULT_KIND_CNT; i++)
+    printf ("%s %u %s", i > 0 ? "," : "", vs->faults[i],
+            fault_kind_names[i]);
+  printf ("\n");
+
+  printf ("%s: vmstats: service cycles:", thread_name ());
+  for (i = 0; i < VMSTATS_HIST_CNT; i++)
+    if (vs->hist[i] != 0)
+      printf (" 2^%d:%u", i, vs->hist[i]);
+  printf ("\n");
+
+#ifdef VM
+  printf ("%s: vmstats: %u evictions, %u swap reads, %u swap writes\n",
+          thread_name (), vs->evictions, vs->swap_reads, vs->swap_writes);
+#endif
+}
@@ -0,0 +1,38 @@
+#ifndef USERPROG_VMSTATS_H
+#define USERPROG_VMSTATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Kinds of page faults, for per-process statistics. */
+enum fault_kind
+  {
+    FAULT_COW,                  /* First write to a shared zero page. */
+    FAULT_SWAP_IN,              /* Access to a page evicted to swap. */
+    FAULT_INVALID,              /* Bad access that kills the process. */
+    FAULT_KIND_CNT              /* Number of kinds. */
+  };
+
+/* Number of buckets in the fault service time histogram.
+   Bucket N counts faults that took 2**N to 2**(N+1) - 1 CPU
+   cycles to service. */
+#define VMSTATS_HIST_CNT 32
+
+/* Virtual memory statistics kept for each user process. */
+struct vmstats
+  {
+    unsigned faults[FAULT_KIND_CNT];    /* Faults of each kind. */
+    unsigned hist[VMSTATS_HIST_CNT];    /* Fault service times. */
+    unsigned evictions;                 /* Frames evicted to satisfy us. */
+    unsigned swap_reads;                /* Our pages read from swap. */
+    unsigned swap_writes;               /* Our pages written to swap. */
+  };
+
+/* If true, print each process's statistics when it exits.
+   Controlled by kernel command-line option "-vmstats". */
+extern bool vmstats_enabled;
+
+void vmstats_fault (enum fault_kind, uint64_t start);
+void vmstats_print (void);
+
+#endif /* userprog/vmstats.h */
@@ -0,0 +1,543 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/swap.h"
+
+/* Frame table.
+
+   Each page from the user pool that backs a user virtual page
+   (a "frame") has an entry here that records the process that
+   owns it and the user virtual address it is mapped at.  When
+   the user pool runs dry, frame_alloc() reclaims a frame by
+   writing its contents to swap, "evicting" it.  The owner's PTE
+   then records the swap slot, and the owner's next access to
+   the page faults it back in through frame_swap_in().
+
+   A single global clock would let one memory-hungry process
+   push out the hot pages of every other process, so victims
+   are chosen with each process's working set in mind.  Once a
+   process has run for WS_SAMPLE_TICKS timer ticks, counted by
+   frame_tick(), the sampler thread counts the frames it has
+   accessed since its last sample; a running average of those
+   counts is its working set estimate, which serves as a soft
+   limit on its resident set.  The sampler moves each accessed
+   bit that it clears into the frame's ACCESSED member, so that
+   the clock still sees it.  Eviction takes frames from the
+   process whose resident set most exceeds its estimate, using a
+   clock (second chance) restricted to that process's frames,
+   and only falls back to a clock over every frame when no
+   process is over its limit.
+
+   A frame may be pinned, while the kernel does I/O directly to
+   or from the user page it backs, so that eviction passes it
+   over.
+
+   All changes to the table, and to the PTEs of processes other
+   than the running one, happen with frame_lock held.  The lock
+   is held across swap I/O, so a process that faults on a page
+   that is still being written out waits until the write is
+   done. */
+
+/* A frame. */
+struct frame
+  {
+    struct hash_elem hash_elem; /* Element in frame_hash. */
+    struct list_elem list_elem; /* Element in frame_list. */
+    void *kpage;                /* Kernel virtual address. */
+    struct thread *owner;       /* Owning process. */
+    uint32_t *pd;               /* OWNER's page directory. */
+    void *upage;                /* User virtual address in PD. */
+    int pin_cnt;                /* Pinned if nonzero. */
+    bool accessed;              /* Accessed bit saved by sampler. */
+  };
+
+/* Ticks a process runs between samples of its working set. */
+#define WS_SAMPLE_TICKS 4
+
+static struct hash frame_hash;          /* Frames, keyed by kpage. */
+static struct list frame_list;          /* Frames, in clock order. */
+static struct list_elem *clock_hand;    /* Next frame for the clock. */
+static struct lock frame_lock;          /* Protects all of the above. */
+static struct kmem_cache frame_cache;   /* Cache of struct frame. */
+
+static thread_func sampler NO_RETURN;
+static void *get_page (enum palloc_flags);
+static void *evict (void);
+static struct frame *choose_victim (void);
+static struct thread *most_over_limit (void);
+static void add_frame (struct frame *, void *kpage, void *upage);
+static void remove_frame (struct frame *);
+static struct frame *lookup_frame (void *kpage);
+static hash_hash_func frame_hash_func;
+static hash_less_func frame_less_func;
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  if (!hash_init (&frame_hash, frame_hash_func, frame_less_func, NULL))
+    PANIC ("frame table creation failed");
+  list_init (&frame_list);
+  clock_hand = list_end (&frame_list);
+  lock_init (&frame_lock);
+  kmem_cache_init (&frame_cache, "frame", sizeof (struct frame), NULL, NULL);
+  if (thread_create ("ws-sampler", PRI_DEFAULT, sampler, NULL) == TID_ERROR)
+    PANIC ("can't create working set sampler");
+}
+
+/* Obtains a frame from the user pool for the running process's
+   user virtual page UPAGE, evicting another frame if necessary,
+   and returns its kernel virtual address.  If PAL_ZERO is set
+   in FLAGS, the frame is filled with zeros.  Returns a null
+   pointer if no frame can be obtained.
+
+   The frame cannot be evicted until it is mapped at UPAGE in
+   the process's page directory. */
+void *
+frame_alloc (enum palloc_flags flags, void *upage)
+{
+  struct frame *f;
+  void *kpage;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  f = kmem_cache_alloc (&frame_cache);
+  if (f == NULL)
+    return NULL;
+
+  lock_acquire (&frame_lock);
+  kpage = get_page (flags);
+  if (kpage != NULL)
+    add_frame (f, kpage, upage);
+  else
+    kmem_cache_free (&frame_cache, f);
+  lock_release (&frame_lock);
+
+  return kpage;
+}
+
+/* Frees KPAGE, which must have been obtained with
+   frame_alloc(). */
+void
+frame_free (void *kpage)
+{
+  lock_acquire (&frame_lock);
+  frame_free_locked (kpage);
+  lock_release (&frame_lock);
+}
+
+/* If user virtual page UPAGE in the running process was evicted
+   to swap, reads it back into a new frame, maps it again, and
+   returns true.  Returns false if UPAGE is not in swap or if no
+   frame can be obtained. */
+bool
+frame_swap_in (void *upage)
+{
+  struct thread *cur = thread_current ();
+  struct frame *f;
+  void *kpage = NULL;
+  size_t slot;
+  bool writable;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  f = kmem_cache_alloc (&frame_cache);
+  if (f == NULL)
+    return false;
+
+  lock_acquire (&frame_lock);
+  if (pagedir_get_swapped (cur->pagedir, upage, &slot, &writable))
+    {
+      kpage = get_page (0);
+      if (kpage != NULL)
+        {
+          swap_read (slot, kpage);
+          swap_free (slot);
+          cur->vmstats.swap_reads++;
+
+          /* The page table already exists, so this can't fail. */
+          pagedir_set_page (cur->pagedir, upage, kpage, writable);
+          add_frame (f, kpage, upage);
+        }
+    }
+  if (kpage == NULL)
+    kmem_cache_free (&frame_cache, f);
+  lock_release (&frame_lock);
+
+  return kpage != NULL;
+}
+
+/* Pins the frame that backs user virtual page UPAGE in the
+   running process, so that it will not be evicted, and returns
+   true.  Returns false if UPAGE is not resident.  Resident
+   pages that are not in the frame table, such as the shared
+   zero page and 4 MB pages, are never evicted anyhow. */
+bool
+frame_pin (void *upage)
+{
+  struct thread *cur = thread_current ();
+  void *kpage;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  lock_acquire (&frame_lock);
+  kpage = pagedir_get_page (cur->pagedir, upage);
+  if (kpage != NULL)
+    {
+      struct frame *f = lookup_frame (kpage);
+      if (f != NULL)
+        f->pin_cnt++;
+    }
+  lock_release (&frame_lock);
+
+  return kpage != NULL;
+}
+
+/* Unpins the frame that backs user virtual page UPAGE in the
+   running process, which must have been pinned with
+   frame_pin(). */
+void
+frame_unpin (void *upage)
+{
+  struct thread *cur = thread_current ();
+  void *kpage;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  lock_acquire (&frame_lock);
+  kpage = pagedir_get_page (cur->pagedir, upage);
+  if (kpage != NULL)
+    {
+      struct frame *f = lookup_frame (kpage);
+      if (f != NULL)
+        {
+          ASSERT (f->pin_cnt > 0);
+          f->pin_cnt--;
+        }
+    }
+  lock_release (&frame_lock);
+}
+
+/* Counts the ticks that the running process runs, for the
+   working set sampler.
+   Called by the timer interrupt handler at each timer tick. */
+void
+frame_tick (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->pagedir != NULL)
+    t->ws_ticks++;
+}
+
+/* Starts a working set sample of T if it has run for
+   WS_SAMPLE_TICKS ticks since its last one, for use by
+   thread_foreach(). */
+static void
+start_sample (struct thread *t, void *aux UNUSED)
+{
+  if (t->pagedir != NULL && t->ws_ticks >= WS_SAMPLE_TICKS)
+    {
+      t->ws_ticks = 0;
+      t->ws_accessed = 0;
+      t->ws_sampling = true;
+    }
+}
+
+/* Folds the sample of T, if one was started, into its working
+   set estimate, for use by thread_foreach(). */
+static void
+finish_sample (struct thread *t, void *aux UNUSED)
+{
+  if (t->ws_sampling)
+    {
+      t->ws_size = (t->ws_size + t->ws_accessed + 1) / 2;
+      t->ws_sampling = false;
+    }
+}
+
+/* Working set sampler thread.  Every WS_SAMPLE_TICKS ticks,
+   samples each process that has run that long since its last
+   sample, by counting and clearing the accessed bits of its
+   frames.  Doing this in a thread, rather than in the timer
+   interrupt, keeps the page table walk out of interrupt
+   context, and since no process's page directory is active
+   while the sampler runs, clearing the bits needs no TLB
+   flush. */
+static void
+sampler (void *aux UNUSED)
+{
+  for (;;)
+    {
+      enum intr_level old_level;
+      struct list_elem *e;
+
+      timer_sleep (WS_SAMPLE_TICKS);
+
+      lock_acquire (&frame_lock);
+      old_level = intr_disable ();
+      thread_foreach (start_sample, NULL);
+      intr_set_level (old_level);
+
+      for (e = list_begin (&frame_list); e != list_end (&frame_list);
+           e = list_next (e))
+        {
+          struct frame *f = list_entry (e, struct frame, list_elem);
+
+          if (f->owner->ws_sampling
+              && pagedir_get_page (f->pd, f->upage) == f->kpage
+              && pagedir_is_accessed (f->pd, f->upage))
+            {
+              pagedir_set_accessed (f->pd, f->upage, false);
+              f->accessed = true;
+              f->owner->ws_accessed++;
+            }
+        }
+
+      old_level = intr_disable ();
+      thread_foreach (finish_sample, NULL);
+      intr_set_level (old_level);
+      lock_release (&frame_lock);
+    }
+}
+
+/* Acquires the frame table lock, which keeps frames from being
+   evicted.  Used by pagedir.c while tearing down a process. */
+void
+frame_table_acquire (void)
+{
+  lock_acquire (&frame_lock);
+}
+
+/* Releases the frame table lock. */
+void
+frame_table_release (void)
+{
+  lock_release (&frame_lock);
+}
+
+/* Frees KPAGE, which must have been obtained with frame_alloc(),
+   with the frame table lock already held. */
+void
+frame_free_locked (void *kpage)
+{
+  frame_forget_locked (kpage);
+  palloc_free_page (kpage);
+}
+
+/* Removes KPAGE, which must have been obtained with
+   frame_alloc(), from the frame table, with the frame table lock
+   already held.  The page is no longer subject to eviction, but
+   remains allocated: the caller must free it with
+   palloc_free_page() or palloc_free_batch(). */
+void
+frame_forget_locked (void *kpage)
+{
+  struct frame *f;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  f = lookup_frame (kpage);
+  ASSERT (f != NULL);
+  remove_frame (f);
+  kmem_cache_free (&frame_cache, f);
+}
+
+/* Obtains a page from the user pool, evicting a frame if the
+   pool is empty.  If PAL_ZERO is set in FLAGS, the page is
+   filled with zeros.  Returns a null pointer on failure. */
+static void *
+get_page (enum palloc_flags flags)
+{
+  void *kpage;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  kpage = palloc_get_page (PAL_USER | flags);
+  if (kpage == NULL)
+    {
+      kpage = evict ();
+      if (kpage != NULL && (flags & PAL_ZERO))
+        memset (kpage, 0, PGSIZE);
+    }
+  return kpage;
+}
+
+/* Evicts a frame to swap and returns its kernel virtual
+   address for reuse, or a null pointer if no frame can be
+   evicted. */
+static void *
+evict (void)
+{
+  struct frame *f;
+  void *kpage;
+  size_t slot;
+
+  f = choose_victim ();
+  if (f == NULL)
+    return NULL;
+  slot = swap_alloc ();
+  if (slot == SWAP_ERROR)
+    return NULL;
+
+  /* Unmap the page before writing it out, so that the owner
+     can't modify it behind our back.  If the owner touches it
+     while we write, it faults and waits for frame_lock. */
+  pagedir_set_swapped (f->pd, f->upage, slot);
+  f->owner->vmstats.swap_writes++;
+  thread_current ()->vmstats.evictions++;
+
+  kpage = f->kpage;
+  remove_frame (f);
+  kmem_cache_free (&frame_cache, f);
+
+  swap_write (slot, kpage);
+  return kpage;
+}
+
+/* Chooses a frame to evict and returns it, or a null pointer if
+   no frame can be evicted. */
+static struct frame *
+choose_victim (void)
+{
+  struct thread *target = most_over_limit ();
+  size_t i, max = 2 * list_size (&frame_list);
+
+  for (;;)
+    {
+      for (i = 0; i < max; i++)
+        {
+          struct frame *f;
+
+          if (clock_hand == list_end (&frame_list))
+            clock_hand = list_begin (&frame_list);
+          f = list_entry (clock_hand, struct frame, list_elem);
+          clock_hand = list_next (clock_hand);
+
+          /* Skip frames of other processes, pinned frames, and
+             frames that aren't mapped yet. */
+          if ((target != NULL && f->owner != target)
+              || f->pin_cnt > 0
+              || pagedir_get_page (f->pd, f->upage) != f->kpage)
+            continue;
+
+          /* Give recently accessed frames a second chance. */
+          if (f->accessed || pagedir_is_accessed (f->pd, f->upage))
+            {
+              f->accessed = false;
+              pagedir_set_accessed (f->pd, f->upage, false);
+            }
+          else
+            return f;
+        }
+
+      if (target == NULL)
+        return NULL;
+      target = NULL;
+    }
+}
+
+/* Finds the process whose resident set most exceeds its working
+   set estimate, for use by thread_foreach(). */
+static void
+find_most_over_limit (struct thread *t, void *max_)
+{
+  struct thread **max = max_;
+
+  if (t->pagedir != NULL && t->resident_cnt > t->ws_size
+      && (*max == NULL
+          || t->resident_cnt - t->ws_size
+             > (*max)->resident_cnt - (*max)->ws_size))
+    *max = t;
+}
+
+/* Returns the process whose resident set most exceeds its
+   working set estimate, or a null pointer if every process is
+   within its estimate. */
+static struct thread *
+most_over_limit (void)
+{
+  struct thread *max = NULL;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  thread_foreach (find_most_over_limit, &max);
+  intr_set_level (old_level);
+
+  return max;
+}
+
+/* Initializes F as the frame at KPAGE, mapped at UPAGE in the
+   running process, and adds it to the frame table.
+
+   F records the process's page directory itself, rather than
+   looking it up through its owner, because process_exit() sets
+   the owner's pagedir to null without frame_lock.  The page
+   directory stays valid for as long as F is in the table, since
+   pagedir_reap() removes its frames, under frame_lock, before
+   the page directory can be freed. */
+static void
+add_frame (struct frame *f, void *kpage, void *upage)
+{
+  f->kpage = kpage;
+  f->owner = thread_current ();
+  f->pd = f->owner->pagedir;
+  f->upage = upage;
+  f->pin_cnt = 0;
+  f->accessed = false;
+  hash_insert (&frame_hash, &f->hash_elem);
+  list_push_back (&frame_list, &f->list_elem);
+  f->owner->resident_cnt++;
+}
+
+/* Removes F from the frame table. */
+static void
+remove_frame (struct frame *f)
+{
+  if (clock_hand == &f->list_elem)
+    clock_hand = list_next (clock_hand);
+  hash_delete (&frame_hash, &f->hash_elem);
+  list_remove (&f->list_elem);
+  f->owner->resident_cnt--;
+}
+
+/* Returns the frame at KPAGE, or a null pointer if there is
+   none. */
+static struct frame *
+lookup_frame (void *kpage)
+{
+  struct frame f;
+  struct hash_elem *e;
+
+  f.kpage = kpage;
+  e = hash_find (&frame_hash, &f.hash_elem);
+  return e != NULL ? hash_entry (e, struct frame, hash_elem) : NULL;
+}
+
+/* Returns a hash value for frame E. */
+static unsigned
+frame_hash_func (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (e, struct frame, hash_elem);
+  return hash_bytes (&f->kpage, sizeof f->kpage);
+}
+
+/* Returns true if frame A precedes frame B. */
+static bool
+frame_less_func (const struct hash_elem *a_, const struct hash_elem *b_,
+                 void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, hash_elem);
+  const struct frame *b = hash_entry (b_, struct frame, hash_elem);
+  return a->kpage < b->kpage;
+}
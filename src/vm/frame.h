@@ -0,0 +1,20 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <stdbool.h>
+#include "threads/palloc.h"
+
+void frame_init (void);
+void *frame_alloc (enum palloc_flags, void *upage);
+void frame_free (void *kpage);
+bool frame_swap_in (void *upage);
+bool frame_pin (void *upage);
+void frame_unpin (void *upage);
+void frame_tick (void);
+
+void frame_table_acquire (void);
+void frame_table_release (void);
+void frame_free_locked (void *kpage);
+void frame_forget_locked (void *kpage);
+
+#endif /* vm/frame.h */
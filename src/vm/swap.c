@@ -0,0 +1,84 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Swap space.
+
+   The swap block device is divided into page-size "slots", each
+   of which can hold the contents of one evicted user page.  A
+   bitmap tracks which slots are in use. */
+
+/* Number of sectors in a slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block *swap_block;        /* Swap device, or null. */
+static struct bitmap *used_slots;       /* In-use slots. */
+static struct lock swap_lock;           /* Protects used_slots. */
+
+/* Initializes the swap space.  If there is no swap device, all
+   attempts to allocate a slot fail. */
+void
+swap_init (void)
+{
+  size_t slot_cnt = 0;
+
+  lock_init (&swap_lock);
+  swap_block = block_get_role (BLOCK_SWAP);
+  if (swap_block != NULL)
+    slot_cnt = block_size (swap_block) / SECTORS_PER_SLOT;
+  used_slots = bitmap_create (slot_cnt);
+  if (used_slots == NULL)
+    PANIC ("swap bitmap creation failed");
+}
+
+/* Allocates a free swap slot and returns its index, or
+   SWAP_ERROR if swap is full. */
+size_t
+swap_alloc (void)
+{
+  size_t slot;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (used_slots, 0, 1, false);
+  lock_release (&swap_lock);
+
+  return slot != BITMAP_ERROR ? slot : SWAP_ERROR;
+}
+
+/* Marks SLOT free for reuse. */
+void
+swap_free (size_t slot)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (used_slots, slot));
+  bitmap_reset (used_slots, slot);
+  lock_release (&swap_lock);
+}
+
+/* Reads the page in SLOT into PAGE. */
+void
+swap_read (size_t slot, void *page)
+{
+  size_t i;
+
+  ASSERT (bitmap_test (used_slots, slot));
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_read (swap_block, slot * SECTORS_PER_SLOT + i,
+                (uint8_t *) page + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Writes PAGE into SLOT. */
+void
+swap_write (size_t slot, const void *page)
+{
+  size_t i;
+
+  ASSERT (bitmap_test (used_slots, slot));
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_write (swap_block, slot * SECTORS_PER_SLOT + i,
+                 (const uint8_t *) page + i * BLOCK_SECTOR_SIZE);
+}